@@ -0,0 +1,41 @@
+/* Example native CALL provider: Hello.Greet(name) and Hello.Sum(n...).
+ *
+ * Build with -DBUILD_EXAMPLE_PLUGINS=ON, then copy hello.so into a plugins
+ * directory (e.g. ~/.config/prismshell/plugins) or point
+ * PRISMSHELL_PLUGIN_PATH at the build directory.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "prismshell/plugin.h"
+
+static int greet(const pb_host_api* host, const pb_value* args, size_t argc,
+                 pb_result* out, void* userdata){
+  (void)argc; (void)userdata;
+  char buf[256];
+  int n = snprintf(buf, sizeof(buf), "Hello, %.*s!", (int)args[0].len, args[0].str);
+  if(n < 0) return 1;
+  host->set_str(out, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+  return 0;
+}
+
+static int sum(const pb_host_api* host, const pb_value* args, size_t argc,
+               pb_result* out, void* userdata){
+  (void)userdata;
+  double total = 0.0;
+  for(size_t i = 0; i < argc; ++i) total += args[i].num;
+  host->set_num(out, total);
+  return 0;
+}
+
+static const pb_function kHello[] = {
+  { "Greet", "s",  greet, NULL },
+  { "Sum",   "n*", sum,   NULL },
+};
+
+const unsigned pb_plugin_abi_version = PB_PLUGIN_ABI_VERSION;
+
+int pb_plugin_init(const pb_host_api* host, pb_registrar* reg){
+  if(host->abi_version != PB_PLUGIN_ABI_VERSION) return 1;
+  return host->register_namespace(reg, "Hello", kHello, sizeof(kHello) / sizeof(kHello[0]));
+}
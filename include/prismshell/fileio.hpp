@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pb {
+
+// File I/O behind the FS.* builtins. Regular files are read through a
+// read-only mmap (one copy per line, into the Value); pipes, devices and
+// files whose size is unknown (/proc) through a 1 MiB read buffer.
+
+// Whole-file read (FS.Read): a single read of the size fstat reports, or
+// chunked reads when there is no size. False if the file cannot be opened.
+bool read_file(const std::string& path, std::string& out);
+
+// Batched reads and stats (FS.ReadMany, FS.StatMany). Every request goes to
+// the kernel at once through io_uring where the kernel supports the needed
+// operations; elsewhere a pool of threads issues them. Results are in input
+// order; `ok` (or FileStat::ok) is false for paths that could not be read.
+struct FileStat {
+  bool ok{false};
+  char kind{'-'};     // 'f' regular file, 'd' directory, 'o' anything else
+  uint64_t size{0};
+  int64_t mtime{0};   // seconds since the epoch
+};
+std::vector<std::string> read_many(const std::vector<std::string>& paths, std::vector<bool>* ok = nullptr);
+std::vector<FileStat> stat_many(const std::vector<std::string>& paths);
+
+// Recursive listing (FS.Walk). Directories are read with getdents64 on a
+// pool of threads and entries are classified by d_type, so no per-entry
+// stat. Paths are `root` joined with the names below it.
+struct WalkOptions {
+  int max_depth{-1};                // -1 unlimited; 1 is root's own entries, 0 nothing
+  std::vector<std::string> names;   // fnmatch() patterns on the entry name; empty: all
+  char type{0};                     // 'f', 'd' or 'l' (symlink) only; 0: all
+  bool hidden{false};               // include (and enter) dot entries
+  bool follow{false};               // enter symlinked directories (each directory once)
+  bool sort{false};                 // sorted output; otherwise in walk order
+};
+std::vector<std::string> walk_tree(const std::string& root, const WalkOptions& opt);
+
+// The same walk, consumed while it runs (FS.WalkOpen): entries come out in
+// walk order (`sort` is ignored) as soon as their directory has been read.
+// The walkers pause while 64K entries are waiting; destroying the stream
+// stops them.
+class WalkStream {
+public:
+  WalkStream(const std::string& root, const WalkOptions& opt);
+  ~WalkStream();
+  WalkStream(const WalkStream&) = delete;
+  WalkStream& operator=(const WalkStream&) = delete;
+
+  bool ok() const;                  // root is a directory
+  bool next(std::string& path);     // blocks for the next entry; false at the end
+  bool eof();                       // blocks until that is known
+
+private:
+  struct State;
+  std::unique_ptr<State> st_;
+};
+
+// Line reader for FS.Open / FS.ReadLine. Lines end at '\n', which is not
+// returned; a last line without one is still a line.
+// If a mapped file is truncated while open, it ends where the reader is.
+class FileReader {
+public:
+  explicit FileReader(const std::string& path);
+  ~FileReader();
+  FileReader(const FileReader&) = delete;
+  FileReader& operator=(const FileReader&) = delete;
+
+  bool ok() const { return ok_; }
+  bool read_line(std::string& line);   // false at end of file
+  bool eof();
+  void close();
+
+private:
+  bool fill();
+
+  bool ok_{false};
+  int fd_{-1};
+  const char* map_{nullptr};   // whole file, when mapped
+  size_t map_len_{0};
+  size_t size_{0};             // shrinks to pos_ if the file is truncated under us
+  size_t pos_{0};
+  std::vector<char> buf_;      // otherwise: buf_[pos_, end_) is unread
+  size_t end_{0};
+};
+
+// Buffered writer for FS.OpenWrite / FS.OpenAppend / FS.WriteHandle. Data
+// reaches the file when 64 KiB have piled up, on flush() and on close(); the
+// runtime flushes its writers when a program ends (interrupted or not), and
+// writers_flush_all() runs before Env.Exit. With SyncOnClose the file is
+// fsync()ed when closed, with SyncEachWrite after every write() as well.
+class FileWriter {
+public:
+  enum Sync { NoSync = 0, SyncOnClose = 1, SyncEachWrite = 2 };
+  FileWriter(const std::string& path, bool append, Sync sync = NoSync);
+  ~FileWriter();                        // close()s
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  bool ok() const { return fd_ >= 0; }
+  bool write(const char* data, size_t n);
+  bool flush();
+  bool close();                         // false if any write or sync failed
+
+private:
+  bool drain_locked();
+
+  std::mutex mu_;
+  int fd_{-1};
+  Sync sync_{NoSync};
+  bool failed_{false};
+  std::string buf_;
+};
+void writers_flush_all();
+
+// FS.Append: one unbuffered write through a small cache of O_APPEND fds
+// keyed by path, instead of open/write/close per call. An entry is reopened
+// when the path no longer names the same file (deleted, rotated).
+bool append_file(const std::string& path, const std::string& text);
+// Drop cached append fds (for `path`, or all when empty): FS.Delete etc.
+void append_cache_forget(const std::string& path = {});
+
+} // namespace pb
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace pb {
+
+// Native glob engine (FS.Glob, unquoted words of passthrough lines). A
+// pattern is brace-expanded, split at '/' and compiled into one matcher per
+// path segment: `*`, `?` (one UTF-8 character), `[a-z]`, `[!x]`/`[^x]`,
+// `[[:alpha:]]` and backslash escapes. A segment that is exactly `**` matches
+// any number of directories, itself included (`src/**/*.cpp` also finds
+// `src/a.cpp`); it does not enter symlinked directories. Literal segments are
+// joined without reading their parent, so only the directories the pattern
+// can reach are listed. Names starting with '.' are matched only by a
+// segment that starts with a literal '.'. A trailing '/' keeps directories.
+struct GlobOptions {
+  bool braces{true};     // a{b,c}d, nested; off: braces are literal (sh)
+  bool globstar{true};   // `**` recursive; off: `**` is `*` (sh)
+};
+
+// Matching paths, sorted (byte order), each once. Empty when nothing matches;
+// a pattern without wildcards yields itself if it exists.
+std::vector<std::string> glob_expand(const std::string& pattern, const GlobOptions& opt = {});
+
+// True if `s` has an unescaped `*`, `?` or `[`.
+bool glob_has_magic(const std::string& s);
+
+// Directory listings read by glob_expand() are cached while a scope is open
+// (one per program run), so repeated globs over the same tree read each
+// directory once. Outside any scope a listing lives for one glob_expand()
+// call. glob_cache_invalidate() drops them all: the runtime calls it after
+// its own file writes and deletes and the launcher after running commands,
+// and a change of working directory drops them too.
+class GlobCacheScope {
+public:
+  GlobCacheScope();
+  ~GlobCacheScope();
+  GlobCacheScope(const GlobCacheScope&) = delete;
+  GlobCacheScope& operator=(const GlobCacheScope&) = delete;
+};
+void glob_cache_invalidate();
+
+} // namespace pb
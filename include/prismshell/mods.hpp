@@ -0,0 +1,34 @@
+#pragma once
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "prismshell/runtime.hpp"
+
+namespace pb {
+
+// Mod roots in search order (later roots override earlier ones), absolute:
+// the project-local `mods` is resolved against the working directory at the
+// time of the call, so stored mod sources keep working after a `cd`.
+std::vector<std::filesystem::path> mod_search_paths();
+
+// Read a mod file into a line-numbered listing (numbered or free-form).
+bool read_mod_program(const std::filesystem::path& p, std::map<int, std::string>& out);
+
+// Register every mod found under mod_search_paths(). Files unchanged since
+// the last run are registered as stubs from the per-root manifest; only new
+// or modified files are executed, and the manifest is refreshed for them.
+void autoload_mods(Runtime& rt);
+
+// Hot reload: watch the roots found by the last autoload_mods() (inotify on
+// Linux, no-op elsewhere). mod_watch_poll() reloads only the files that were
+// created, modified or deleted and applies the result to the registry in one
+// step; call it between REPL commands. Returns true if the registry changed.
+void mod_watch_start();
+bool mod_watch_poll();
+
+// Where the manifest for a mod root is persisted.
+std::filesystem::path mod_manifest_path(const std::filesystem::path& root);
+
+} // namespace pb
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "prismshell/parser.hpp"  // ParseOut
+
+namespace pb {
+
+// Parsed form of one source line. `err` set means "does not parse as BASIC".
+using ParsedLine = std::shared_ptr<const ParseOut>;
+
+// Bounded LRU cache: (source text, line number) -> parsed statements.
+// Negative results are cached too, so lines that end up as shell commands
+// only pay for the lexer/parser once.
+struct ParseCache {
+  explicit ParseCache(size_t capacity = 512) : cap(capacity ? capacity : 1) {}
+
+  ParsedLine get(const std::string& src, int line);  // parse on miss
+  void clear();
+  size_t size() const;
+
+  size_t cap;
+
+private:
+  struct Node { std::string key; ParsedLine val; };
+  mutable std::mutex mu;
+  std::list<Node> lru;  // front = most recently used
+  std::unordered_map<std::string, std::list<Node>::iterator> index;
+};
+
+// Process-wide cache used by direct mode (REPL lines, internal CALLs).
+ParseCache& direct_parse_cache();
+
+} // namespace pb
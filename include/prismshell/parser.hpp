@@ -6,6 +6,7 @@
 
 #include "prismshell/utils.hpp"   // Value, Error, helpers
 #include "prismshell/lexer.hpp"   // Token, TokKind
+#include "prismshell/plugins.hpp" // CallBinding
 
 namespace pb {
 
@@ -25,6 +26,7 @@ struct Expr {
   // identifiers / calls
   std::string name;          // for Var or CallFn
   std::vector<ExprPtr> args; // for CallFn
+  mutable CallBinding bind;  // CallFn: plugin target, resolved on first use
 
   // binary arithmetic
   char op{0};                // + - * /
@@ -60,6 +62,7 @@ struct Stmt {
 
   // CALL
   std::string callName; std::vector<ExprPtr> callArgs;
+  mutable CallBinding callBind;  // plugin target, resolved on first use
 
   // GOTO/GOSUB targets
   int targetLine{-1};
@@ -91,7 +94,7 @@ private:
 };
 
 // Is the first token of a line an Id equal to kw (case-insensitive)?
-static bool first_token_is_id_kw(const std::string& src, int line, const char* kw){
+inline bool first_token_is_id_kw(const std::string& src, int line, const char* kw){
   Lexer lx(src, line);
   auto ts = lx.lex();
   if(ts.empty()) return false;
@@ -0,0 +1,82 @@
+/* PrismShell native plugin ABI (C, stable).
+ *
+ * A plugin is a shared object exporting pb_plugin_abi_version (the ABI it was
+ * built against) and pb_plugin_init(). It registers one or
+ * more namespaces of typed functions, callable from BASIC as Ns.Fn(args...).
+ * The host resolves each call site once and caches the binding, so calls do
+ * not pay for a name lookup.
+ *
+ *   static int hello(const pb_host_api* h, const pb_value* a, size_t n,
+ *                    pb_result* out, void* ud) {
+ *     h->set_str(out, a[0].str, a[0].len);
+ *     return 0;
+ *   }
+ *   static const pb_function fns[] = { { "Echo", "s", hello, NULL } };
+ *   const unsigned pb_plugin_abi_version = PB_PLUGIN_ABI_VERSION;
+ *   int pb_plugin_init(const pb_host_api* h, pb_registrar* r) {
+ *     return h->register_namespace(r, "Hello", fns, 1);
+ *   }
+ */
+#ifndef PRISMSHELL_PLUGIN_H
+#define PRISMSHELL_PLUGIN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PB_PLUGIN_ABI_VERSION 1u
+#define PB_PLUGIN_ENTRY "pb_plugin_init"
+#define PB_PLUGIN_ABI_SYMBOL "pb_plugin_abi_version"
+
+typedef enum pb_value_kind { PB_NIL = 0, PB_NUM = 1, PB_STR = 2 } pb_value_kind;
+
+/* Argument value. Strings are borrowed for the duration of the call and are
+ * not necessarily NUL-terminated. */
+typedef struct pb_value {
+  pb_value_kind kind;
+  double num;
+  const char* str;
+  size_t len;
+} pb_value;
+
+typedef struct pb_result pb_result;        /* opaque: return value slot */
+typedef struct pb_registrar pb_registrar;  /* opaque: registration context */
+typedef struct pb_host_api pb_host_api;
+
+/* Return 0 on success; non-zero makes the call evaluate to nil. */
+typedef int (*pb_plugin_fn)(const pb_host_api* host, const pb_value* args, size_t argc,
+                            pb_result* out, void* userdata);
+
+typedef struct pb_function {
+  const char* name;       /* function name without namespace, e.g. "Status" */
+  const char* params;     /* one char per parameter: 's' string, 'n' number,
+                             'v' as-is; a trailing '*' lets the last one
+                             repeat zero or more times.
+                             Arguments are coerced before the call; calls with
+                             the wrong count evaluate to nil. */
+  pb_plugin_fn fn;
+  void* userdata;
+} pb_function;
+
+struct pb_host_api {
+  unsigned abi_version;
+  void (*set_num)(pb_result* out, double v);
+  void (*set_str)(pb_result* out, const char* s, size_t len);
+  /* Register `n` functions under namespace `ns` (e.g. "Git"). Builtin
+   * namespaces (Env, TTY, FS, Mod, ...) are reserved. Returns 0 on success. */
+  int (*register_namespace)(pb_registrar* reg, const char* ns, const pb_function* fns, size_t n);
+};
+
+/* Exported by every plugin. The host loads nothing from an object whose
+ * pb_plugin_abi_version is missing or differs from its own; pb_plugin_init()
+ * returns 0 on success. */
+extern const unsigned pb_plugin_abi_version;
+int pb_plugin_init(const pb_host_api* host, pb_registrar* reg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRISMSHELL_PLUGIN_H */
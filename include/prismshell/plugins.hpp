@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "prismshell/plugin.h"
+#include "prismshell/utils.hpp"
+
+namespace pb {
+
+// One registered plugin function, e.g. "GIT.STATUS". Entries are never freed
+// (plugins stay loaded), so call sites may keep raw pointers to them.
+struct PluginFn {
+  std::string qname;    // uppercase "NS.FN"
+  std::string params;   // see pb_function::params
+  pb_plugin_fn fn{nullptr};
+  void* userdata{nullptr};
+};
+
+// Per-call-site binding cache stored on Expr/Stmt nodes. `gen` records the
+// plugin generation it was resolved against; `fn` is null for builtins.
+struct CallBinding {
+  std::atomic<unsigned> gen{0};
+  std::atomic<const PluginFn*> fn{nullptr};
+};
+
+// Resolve (once per plugin generation) the plugin function for a call site.
+const PluginFn* plugin_bind(CallBinding& b, const std::string& qname);
+Value plugin_call(const PluginFn& f, const std::vector<Value>& args);
+
+// Load a single shared object; returns false and sets *err on failure.
+bool plugin_load(const std::string& path, std::string* err);
+// Load every *.so from the plugin directories (~/.config/prismshell/plugins,
+// the system ones and absolute PRISMSHELL_PLUGIN_PATH entries). Safe to call
+// more than once.
+void plugins_autoload();
+// Loaded plugin files and their namespaces, for `mods plugins`.
+std::vector<std::string> plugin_list();
+
+} // namespace pb
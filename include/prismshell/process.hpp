@@ -0,0 +1,216 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "prismshell/runtime.hpp"  // OutputSink
+
+namespace pb {
+
+// Native launcher for shell passthrough lines. Pipelines of simple commands
+// with redirections (`a | b 2>&1 | c > out`, `< in`, `>>`) are parsed here,
+// wired with pipe2 + posix_spawn file actions and run concurrently; glob
+// words are expanded by glob_expand(). Lines that need a real shell
+// (expansions, lists, subshells, assignments, shell builtins) run under a
+// non-login `/bin/sh -c`.
+//
+// Statuses are shell-style: the exit code, 128+N when killed by signal N,
+// 127 when the program is not found, 126 when it cannot be executed. A
+// pipeline's status is that of its last stage.
+
+struct Redirect {
+  enum Kind { In, Out, Append, Dup };
+  int fd{1};
+  Kind kind{Out};
+  std::string path;   // In/Out/Append
+  int target{-1};     // Dup: fd becomes a copy of target (N>&M)
+};
+
+struct Stage {
+  std::vector<std::string> argv;
+  std::vector<Redirect> redirs;   // applied in order, after the pipe ends
+};
+
+// Parse `line` into pipeline stages. False if it uses anything else a POSIX
+// shell would have to interpret.
+bool parse_pipeline(const std::string& line, std::vector<Stage>& out);
+
+// True if `line` cannot be run by the native launcher.
+bool needs_shell(const std::string& line);
+
+// Resolve a program on $PATH. Names containing '/' are returned unchanged.
+// Empty if nothing executable was found. Lookups go through the command hash.
+std::string resolve_program(const std::string& name);
+
+// Command hash (like sh's `hash`): command name -> resolved path, with a hit
+// count. Cleared when $PATH changes; an entry whose file is gone is dropped
+// and searched again on its next use.
+struct HashedCommand {
+  std::string name;
+  std::string path;
+  unsigned hits{0};
+};
+std::vector<HashedCommand> command_hash_list();   // sorted by name
+std::string command_hash_add(const std::string& name);   // resolve + remember, no hit
+bool command_hash_forget(const std::string& name);
+void command_hash_clear();
+
+// Executable names on $PATH starting with `prefix` (tab completion). The
+// listing is built once per PATH and rebuilt when a PATH directory changes.
+std::vector<std::string> path_commands(const std::string& prefix);
+
+// Start `path` with `argv` (argv[0] is the name the program sees), restoring
+// default signal dispositions in the child, and wait for it.
+int spawn_wait(const std::string& path, const std::vector<std::string>& argv);
+
+// Stages that run inside the shell (mods). `handles(argv0)` selects them;
+// `run(argv, in_fd, out_fd)` executes one on a worker thread, with -1 meaning
+// the shell's own stdin/stdout. The launcher closes the fds afterwards.
+struct InProcStages {
+  std::function<bool(const std::string&)> handles;
+  std::function<int(const std::vector<std::string>&, int, int)> run;
+};
+
+// Run parsed stages concurrently and wait for all of them. `cmd` names the
+// job if it is stopped (defaults to the stages' words).
+int run_pipeline(const std::vector<Stage>& stages, const InProcStages* inproc = nullptr,
+                 const std::string& cmd = {});
+
+// Run one passthrough line: native pipeline, or /bin/sh -c. A trailing `&`
+// starts it as a background job instead (never through the coprocess; mod
+// stages are refused). Callers that already ran parse_pipeline() on a
+// foreground line pass the stages as `parsed`.
+int run_command_line(const std::string& line, const InProcStages* inproc = nullptr,
+                     const std::vector<Stage>* parsed = nullptr);
+
+// True if `line` ends in an unquoted `&` (not `&&`, `|&` or `>&`); *rest gets
+// the command without it.
+bool split_background(const std::string& line, std::string* rest);
+
+// Job control. jobs_init() is called once by the REPL: with a terminal it
+// takes the foreground, ignores SIGTSTP/SIGTTIN/SIGTTOU and from then on runs
+// each line in its own process group, handing it the terminal so Ctrl-C and
+// Ctrl-Z reach only that job. SIGCHLD is blocked and read via a signalfd.
+// jobs_notify() reaps background jobs and prints the ones that finished or
+// stopped (before each prompt). jobs_shutdown() hangs up stopped jobs on exit.
+// job_command() runs the `jobs [-l|-p]`, `fg [%N]`, `bg [%N]` and
+// `wait [%N|pid ...]` builtins.
+void jobs_init();
+void jobs_notify();
+void jobs_shutdown();
+int  job_command(const std::vector<std::string>& argv);
+
+// Persistent coprocess: with PRISMSHELL_COPROC=1, lines that need a real
+// shell go to one long-lived /bin/sh instead of a fresh `sh -c`, so shell
+// variables, functions and `cd` persist between lines (simple commands
+// naming no program are sent there too, since they may be shell functions).
+// Its cwd follows the interpreter's before each line, and the interpreter
+// adopts a `cd` done in the shell. If the shell exits (`exit`), the next line
+// starts a new one.
+bool coproc_enabled();
+int  coproc_run(const std::string& line);
+
+// A command whose stdout the shell reads through a pipe (Shell.Capture,
+// Shell.Lines). Same launcher as passthrough lines, except that lines needing
+// a shell always get a fresh `sh -c`. stdin and stderr stay the shell's and
+// there is no job control: it runs in the shell's process group.
+class CommandReader {
+public:
+  explicit CommandReader(const std::string& line, const InProcStages* inproc = nullptr);
+  ~CommandReader();                    // close()s
+  CommandReader(const CommandReader&) = delete;
+  CommandReader& operator=(const CommandReader&) = delete;
+
+  bool ok() const;                     // started and not closed
+  std::istream& in();                  // its stdout, buffered (line reads)
+  size_t read(char* buf, size_t n);    // its stdout, unbuffered; 0 at EOF
+  // Stop reading and wait for it: the command's status. A command still
+  // writing gets SIGPIPE. Repeated calls return the same status.
+  int close();
+
+private:
+  struct State;
+  std::unique_ptr<State> st_;
+};
+
+// Bounded parallel execution (Shell.Parallel), like `xargs -P`. Each line runs
+// through the launcher in its own process group with /dev/null as stdin, at
+// most `max_jobs` at a time (0: one per CPU). Statuses come back in input
+// order. With `outputs`, each command's stdout is captured into its slot
+// instead of going to the shell's; past `out_cap` bytes it is still read, so
+// the command can finish, but dropped. Once `cancelled()` returns true nothing
+// new starts and running commands get SIGINT; ones that never started report
+// 130.
+struct ParallelProgress {
+  std::atomic<size_t> total{0}, started{0}, done{0}, failed{0};
+};
+std::vector<int> run_parallel(const std::vector<std::string>& lines, size_t max_jobs,
+                              std::vector<std::string>* outputs, size_t out_cap,
+                              ParallelProgress* progress, const std::function<bool()>& cancelled);
+
+// A run_parallel() batch on its own thread (Shell.Start): the caller keeps
+// going and polls progress() until it collects the batch with wait().
+// Destroying a batch that is still running cancels it and waits.
+class ParallelBatch {
+public:
+  ParallelBatch(std::vector<std::string> lines, size_t max_jobs, bool capture, size_t out_cap);
+  ~ParallelBatch();
+  ParallelBatch(const ParallelBatch&) = delete;
+  ParallelBatch& operator=(const ParallelBatch&) = delete;
+
+  const ParallelProgress& progress() const { return progress_; }
+  // Statuses in input order. While waiting, `cancelled()` is polled (Ctrl-C)
+  // and cancels the batch once it returns true. Repeated calls return the
+  // same statuses.
+  const std::vector<int>& wait(const std::function<bool()>& cancelled);
+  void cancel() { cancel_.store(true, std::memory_order_relaxed); }
+  // Captured stdout per command (empty without capture); valid after wait().
+  const std::vector<std::string>& outputs() const { return outputs_; }
+
+private:
+  std::vector<std::string> lines_;
+  std::vector<std::string> outputs_;
+  std::vector<int> status_;
+  ParallelProgress progress_;
+  std::atomic_bool cancel_{false};
+  std::atomic_bool done_{false};
+  bool joined_{false};
+  std::thread thread_;
+};
+
+// waitpid() status -> shell status (exit code or 128+signal).
+int wait_status_code(int status);
+
+// Runtime I/O over file descriptors (mod pipeline stages). Neither owns the fd.
+struct FdSink : OutputSink {
+  int fd;
+  bool broken{false};   // reader went away (EPIPE): drop further output
+  explicit FdSink(int f) : fd(f) {}
+  void write(const char* data, size_t n) override;
+};
+
+class FdInBuf : public std::streambuf {
+public:
+  explicit FdInBuf(int f) : fd_(f) {}
+  // Hand the read-ahead back (lseek) if the fd is seekable, so the next
+  // reader of the fd starts right after what was consumed; on a pipe it
+  // stays buffered.
+  void release();
+protected:
+  int_type underflow() override;
+private:
+  int fd_;
+  char buf_[4096];
+};
+
+struct FdIStream : std::istream {
+  FdInBuf buf;
+  explicit FdIStream(int fd) : std::istream(nullptr), buf(fd) { rdbuf(&buf); }
+};
+
+} // namespace pb
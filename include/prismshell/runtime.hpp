@@ -1,20 +1,112 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <map>
+#include <memory>
 #include <vector>
 #include <optional>
 #include <random>
 
 #include "prismshell/utils.hpp"
 #include "prismshell/parser.hpp"  // ExprPtr, StmtPtr
+#include "prismshell/parse_cache.hpp"  // ParsedLine
 
 namespace pb {
 
+// Compiled listing: sorted line table, per-line parse results and the first
+// keyword of each line (for block scans). Built once and shared read-only;
+// parse errors are kept per line and only raised when that line executes.
+struct ProgramImage {
+  std::vector<int> lines;
+  std::vector<ParsedLine> parsed;
+  std::vector<std::string> kw;   // uppercase first identifier, "" otherwise
+
+  static std::shared_ptr<const ProgramImage> compile(const std::map<int, std::string>& program);
+  // Index of the first line >= `line` (lines.size() if none).
+  size_t index_of(int line) const;
+};
+
+// A Mod.Register() call captured instead of applied (parallel autoload).
+struct ModRegistration {
+  std::string name;
+  int entry{0};
+  std::shared_ptr<const std::map<int, std::string>> program;  // null: load lazily from source
+  std::string source;                                         // mod file path
+};
+
+// Destination for PRINT / TTY.Write / TTY.WriteLine. A Runtime with no sink
+// writes to std::cout.
+struct OutputSink {
+  virtual ~OutputSink() = default;
+  virtual void write(const char* data, size_t n) = 0;
+};
+
+// The interpreter's stdout: output of a Runtime with no sink, and of
+// std::cout, which is pointed at it on first use so messages stay in order
+// with PRINT output. Large blocks when stdout is a pipe or file, whole lines
+// on a terminal. stdout_flush() runs before input is read, before commands
+// and children start (they write fd 1 directly), after a mod printing to the
+// terminal, on exit and for TTY.Flush().
+OutputSink& stdout_sink();
+void stdout_flush();
+bool stdout_is_tty();
+
+// Growable in-memory buffer (Mod.Capture, mod pipelines).
+struct StringSink : OutputSink {
+  std::string buf;
+  void write(const char* data, size_t n) override { buf.append(data, n); }
+};
+
+class CommandReader;   // process.hpp
+class FileReader;      // fileio.hpp
+class FileWriter;      // fileio.hpp
+class WalkStream;      // fileio.hpp
+struct Stage;          // process.hpp
+class ParallelBatch;   // process.hpp
+
+// Work done by one Runtime, for per-mod profiling. Cheap enough to keep on
+// unconditionally; mod_run_capture() resets and reads them around each call.
+struct ExecCounters {
+  uint64_t stmts{0};     // statements executed
+  uint64_t builtins{0};  // CALLs and function calls (builtins and plugins)
+  uint64_t bytes{0};     // bytes printed (PRINT, INPUT prompt, TTY.*)
+};
+
+// Variables, shared copy-on-write: a copy of a VarMap (the prompt renderer's
+// snapshot of the session) shares the storage until either side writes, and
+// only a write made while it is still shared pays for a copy.
+class VarMap {
+public:
+  using Map = std::map<std::string, Value>;
+  Map::const_iterator find(const std::string& k) const { return m_->find(k); }
+  Map::const_iterator end() const { return m_->end(); }
+  Value& operator[](const std::string& k){ return own()[k]; }
+  void clear(){ if(m_.use_count() > 1) m_ = std::make_shared<Map>(); else m_->clear(); }
+private:
+  Map& own(){ if(m_.use_count() > 1) m_ = std::make_shared<Map>(*m_); return *m_; }
+  std::shared_ptr<Map> m_ = std::make_shared<Map>();
+};
+
 struct Runtime {
-  std::map<std::string, Value> vars;   // variables (incl. PB_ARGV)
+  VarMap vars;                          // variables (incl. PB_ARGV)
   std::map<int, std::string> program;  // line-numbered source
   Value lastCall;                       // `_`
 
+  // Layered scope (mods): reads fall through to the parent's variables,
+  // writes land in `vars` (copy-on-write per variable). Parent must outlive us.
+  const Runtime* scope_parent{nullptr};
+  // Immutable program shared with the mod registry; used instead of `program`.
+  std::shared_ptr<const std::map<int, std::string>> shared_program;
+
+  // Pre-compiled image of code(); if null, run_program compiles one per run.
+  std::shared_ptr<const ProgramImage> image;
+
+  const Value* lookup(const std::string& name) const;
+  const std::map<int, std::string>& code() const { return shared_program ? *shared_program : program; }
+
   // Execution
   Result run_line_direct(const std::string& line, int lineNo=0);
   Result run_program();                 // run from beginning (existing behavior)
@@ -25,12 +117,61 @@ struct Runtime {
   bool save(const std::string& path);
   bool load(const std::string& path);
 
-  // Shell passthrough
-  int sh_exec(const std::string& line);
+  // Shell passthrough. Registered mods (or those `mod_stage` accepts) may
+  // appear as pipeline stages. `parsed`, if given, is parse_pipeline(line)
+  // (a foreground line the caller already parsed). Returns a shell-style status.
+  int sh_exec(const std::string& line, const std::function<bool(const std::string&)>& mod_stage = {},
+              const std::vector<Stage>* parsed = nullptr);
+
+  // Commands opened with Shell.Lines(), by handle, and the status of the last
+  // Shell.Run/Capture/Close/Parallel (Shell.Status()).
+  std::map<int, std::shared_ptr<CommandReader>> readers;
+  int next_reader{1};
+  int shell_status{0};
+  // Batches started with Shell.Start(), by handle (Shell.Progress/Wait), and
+  // the captured outputs of the last one collected (Shell.Output).
+  std::map<int, std::shared_ptr<ParallelBatch>> batches;
+  int next_batch{1};
+  std::vector<std::string> parallel_out;
+
+  // Files opened with FS.Open() and FS.OpenWrite/OpenAppend(), and walks
+  // started with FS.WalkOpen(), by handle (one numbering). Writers are
+  // flushed whenever a program run ends.
+  std::map<int, std::shared_ptr<FileReader>> files;
+  std::map<int, std::shared_ptr<FileWriter>> writers;
+  std::map<int, std::shared_ptr<WalkStream>> walks;
+  int next_file{1};
 
   // Internals used by the interpreter/runtime
   Value  eval(const ExprPtr& e);
   Result exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack);
+  const ProgramImage* active_image{nullptr};  // image of the running program
+  std::string line_kw(int line, const std::string& src) const;
+  ParsedLine  line_parsed(int line, const std::string& src) const;
+
+  // Install the Ctrl-C trap while run_program() runs. Off for runtimes
+  // executed on worker threads (the REPL thread owns SIGINT); those can be
+  // stopped through `cancel` instead, which mods they run inherit.
+  bool trap_sigint{true};
+  const std::atomic_bool* cancel{nullptr};
+
+  // Set for runtimes that run beside the REPL (the prompt render): builtins
+  // that change process-wide state or wait on the terminal do nothing and
+  // return empty (see restricted_builtin()). Inherited by mods they run.
+  bool restricted{false};
+
+  // When set, Mod.Register() appends here instead of touching the registry.
+  std::vector<ModRegistration>* mod_sink{nullptr};
+
+  ExecCounters counters;
+
+  // I/O redirection for mods. Both are inherited by mods this runtime runs;
+  // null means the terminal (std::cout / std::cin). Prompts of INPUT and
+  // TTY.ReadLine are only shown when reading from the terminal.
+  OutputSink*   sink{nullptr};
+  std::istream* input{nullptr};
+  void write_out(const std::string& s);
+  bool read_line(std::string& line);
 
   // RNG state (per-runtime)
   std::mt19937_64 rng{};
@@ -42,7 +183,32 @@ Value call_dispatch(Runtime& rt, const std::string& qname, const std::vector<Val
 
 // (Optional) Mod registry API — useful if other translation units need it
 bool mod_has(const std::string& name);
+// Changes whenever mods are registered or removed (for caches keyed on names).
+unsigned mod_generation();
 int  mod_run(const std::string& name, const std::vector<std::string>& args, Runtime& parent);
+// Run a mod with its output sent to `sink` and its input read from `in`
+// (either may be null: inherit the parent's). Returns the exit status.
+int  mod_run_io(const std::string& name, const std::vector<std::string>& args, Runtime& parent,
+                OutputSink* sink, std::istream* in);
+// Atomically remove `drop` and apply captured registrations in order (later
+// entries win), under one lock.
+void mod_apply(const std::vector<ModRegistration>& regs, const std::vector<std::string>& drop = {});
+
+// Per-mod profile, one row per mod that has run: calls, errors, wall time
+// (total/mean/p99/max, ms), statements, builtin calls and bytes printed.
+// `tsv` gives a header plus tab-separated rows (Mod.Stats, exit dump),
+// otherwise an aligned table for the REPL.
+std::string mod_stats_table(bool tsv);
+void mod_stats_reset();
+// Write the TSV table to `path` ("%h" -> hostname, "%p" -> pid). Called at
+// exit when PRISMSHELL_MOD_STATS is set.
+bool mod_stats_dump(const std::string& path);
+
+// Prompt invalidation counter: bumped whenever something a prompt may show
+// changes (template, mod registry, environment, cwd). The interpreter caches
+// the rendered prompt against it.
+unsigned long prompt_epoch();
+void prompt_invalidate();
 
 
 
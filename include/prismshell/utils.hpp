@@ -4,6 +4,7 @@
 #include <optional>
 #include <variant>
 #include <map>
+#include <functional>
 
 
 namespace pb {
@@ -30,6 +31,19 @@ std::string trim(std::string s);
 bool starts_with(const std::string& s, const std::string& p);
 bool iequals(const std::string& a, const std::string& b);
 std::vector<std::string> split_csv_like(const std::string& s);
+// Shell-like word splitting: "double", 'single' and backslash escapes.
+std::vector<std::string> tokenize_quoted(const std::string& line);
+// List values: a JSON-ish array (`["a","b",3]`, as in PB_ARGV; items may also
+// be 'single-quoted') or, otherwise,
+// newline-separated text (blank lines skipped).
+std::vector<std::string> split_list(const std::string& s);
+// The JSON-ish array form of `items` (quoted, escaped strings).
+std::string join_list(const std::vector<std::string>& items);
+
+
+// Run fn(0..n-1) on up to max_threads workers (0 = hardware concurrency).
+// Items are handed out dynamically; returns when all have finished.
+void parallel_for(size_t n, const std::function<void(size_t)>& fn, unsigned max_threads=0);
 
 
 } // namespace pb
\ No newline at end of file
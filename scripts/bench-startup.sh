@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+# Startup benchmark: time shell start + mod autoload against generated mods.
+set -euo pipefail
+
+usage() {
+  cat <<'USAGE'
+Usage: scripts/bench-startup.sh [path/to/prismshell]
+
+Generates $MODS mod files spread over $ROOTS roots (via PRISMSHELL_MOD_PATH),
+then starts the shell $RUNS times with "BYE" on stdin and reports wall time.
+
+Env:
+  MODS=400   number of generated mods
+  ROOTS=4    number of mod roots
+  LINES=40   BASIC lines per mod body
+  RUNS=10    timed runs
+  KEEP=1     keep the generated directory
+USAGE
+}
+
+case "${1:-}" in -h|--help) usage; exit 0 ;; esac
+
+BIN="${1:-build/Release/prismshell}"
+[[ -x "$BIN" ]] || { echo "prismshell binary not found: $BIN" >&2; usage; exit 1; }
+BIN="$(cd "$(dirname "$BIN")" && pwd)/$(basename "$BIN")"
+
+MODS="${MODS:-400}"
+ROOTS="${ROOTS:-4}"
+LINES="${LINES:-40}"
+RUNS="${RUNS:-10}"
+
+WORK="$(mktemp -d "${TMPDIR:-/tmp}/pbsh-bench.XXXXXX")"
+[[ -n "${KEEP:-}" ]] || trap 'rm -rf "$WORK"' EXIT
+
+# ---- generate mods -----------------------------------------------------------
+MOD_PATH=""
+for ((r = 0; r < ROOTS; r++)); do
+  mkdir -p "$WORK/root$r"
+  MOD_PATH="${MOD_PATH:+$MOD_PATH:}$WORK/root$r"
+done
+
+for ((i = 0; i < MODS; i++)); do
+  root=$((i % ROOTS))
+  {
+    echo "10 CALL Mod.Register(\"bench$i\", 100)"
+    echo "20 END"
+    for ((l = 0; l < LINES; l++)); do
+      echo "$((100 + l * 10)) LET X$l = PB_ARGC + $l"
+    done
+    echo "$((100 + LINES * 10)) END"
+  } > "$WORK/root$root/bench$i.bas"
+done
+
+mkdir -p "$WORK/home" "$WORK/cwd"
+
+# ---- timed runs --------------------------------------------------------------
+now_ns() { date +%s%N; }
+
+total=0; best=""
+for ((k = 0; k < RUNS; k++)); do
+  t0=$(now_ns)
+  (cd "$WORK/cwd" && echo BYE | HOME="$WORK/home" PRISMSHELL_MOD_PATH="$MOD_PATH" "$BIN" >/dev/null)
+  t1=$(now_ns)
+  ms=$(( (t1 - t0) / 1000000 ))
+  total=$((total + ms))
+  if [[ -z "$best" || $ms -lt $best ]]; then best=$ms; fi
+done
+
+echo "mods=$MODS roots=$ROOTS lines=$LINES runs=$RUNS"
+echo "startup: best ${best} ms, mean $((total / RUNS)) ms"
+[[ -z "${KEEP:-}" ]] || echo "generated mods kept in $WORK"
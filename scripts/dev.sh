@@ -18,6 +18,7 @@ Commands:
   build|-b   Build
   run|-r     Run prismshell
   test|-t    CTest (if tests are added)
+  bench      Startup benchmark against generated mods (scripts/bench-startup.sh)
   install|-i Install to --prefix (default /usr/local, override PREFIX)
   clean      Remove build dir
   shell      Open subshell in build dir
@@ -59,6 +60,11 @@ case "$cmd" in
     ctest --test-dir "$BUILD_DIR" --output-on-failure
     ;;
 
+  bench)
+    cmake --build "$BUILD_DIR" -j"${JOBS:-}"
+    "$(dirname "$0")/bench-startup.sh" "$BUILD_DIR/prismshell"
+    ;;
+
   install|-i)
     cmake --build "$BUILD_DIR" -j"${JOBS:-}"
     cmake --install "$BUILD_DIR" --prefix "${PREFIX:-/usr/local}"
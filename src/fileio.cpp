@@ -0,0 +1,881 @@
+#include "prismshell/fileio.hpp"
+#include "prismshell/utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <set>
+#include <thread>
+
+#ifndef _WIN32
+  #include <csetjmp>
+  #include <csignal>
+  #include <dirent.h>
+  #include <fcntl.h>
+  #include <fnmatch.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+#ifdef __linux__
+  #include <sys/syscall.h>
+  #if __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+  #endif
+#endif
+
+namespace pb {
+
+#ifndef _WIN32
+
+static constexpr size_t kReadBuf = size_t(1) << 20;
+
+static ssize_t read_some(int fd, char* buf, size_t n){
+  ssize_t r;
+  do { r = ::read(fd, buf, n); } while(r < 0 && errno == EINTR);
+  return r;
+}
+
+bool read_file(const std::string& path, std::string& out){
+  out.clear();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) return false;
+  struct stat st{};
+  size_t have = 0;
+  if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+    // Exact size: no growth, no copy. A file that shrank meanwhile ends early.
+    out.resize((size_t)st.st_size);
+    while(have < out.size()){
+      ssize_t r = read_some(fd, &out[have], out.size() - have);
+      if(r <= 0) break;
+      have += (size_t)r;
+    }
+    out.resize(have);
+  } else {
+    for(;;){
+      out.resize(have + 65536);
+      ssize_t r = read_some(fd, &out[have], 65536);
+      if(r <= 0) break;
+      have += (size_t)r;
+    }
+    out.resize(have);
+  }
+  ::close(fd);
+  return true;
+}
+
+// A mapped file that another process truncates (copytruncate log rotation)
+// raises SIGBUS on the pages past its new end. Reads from a mapping go
+// through map_copy(), under a handler that jumps back out of the fault so the
+// reader can treat the file as ended there. A SIGBUS outside a guarded read
+// gets the previous disposition back and faults again with it.
+namespace {
+thread_local sigjmp_buf* t_bus_jmp = nullptr;
+struct sigaction g_prev_bus;
+
+void on_sigbus(int, siginfo_t*, void*){
+  if(sigjmp_buf* j = t_bus_jmp) siglongjmp(*j, 1);
+  sigaction(SIGBUS, &g_prev_bus, nullptr);
+}
+
+void install_sigbus_guard(){
+  static std::once_flag once;
+  std::call_once(once, []{
+    struct sigaction sa{};
+    sa.sa_sigaction = on_sigbus;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;   // NODEFER: siglongjmp leaves the mask alone
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, &g_prev_bus);
+  });
+}
+
+// memchr / memcpy on a mapping; false if its pages are gone.
+bool map_scan(const char* src, size_t n, const char** nl){
+  sigjmp_buf jmp;
+  if(sigsetjmp(jmp, 0)){ t_bus_jmp = nullptr; return false; }
+  t_bus_jmp = &jmp;
+  *nl = static_cast<const char*>(std::memchr(src, '\n', n));
+  t_bus_jmp = nullptr;
+  return true;
+}
+
+bool map_copy(char* dst, const char* src, size_t n){
+  sigjmp_buf jmp;
+  if(sigsetjmp(jmp, 0)){ t_bus_jmp = nullptr; return false; }
+  t_bus_jmp = &jmp;
+  std::memcpy(dst, src, n);
+  t_bus_jmp = nullptr;
+  return true;
+}
+}
+
+FileReader::FileReader(const std::string& path){
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd_ < 0) return;
+  ok_ = true;
+  struct stat st{};
+  if(fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+    void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if(m != MAP_FAILED){
+      install_sigbus_guard();
+      madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+      map_ = static_cast<const char*>(m);
+      size_ = map_len_ = (size_t)st.st_size;
+      ::close(fd_);   // the mapping keeps the file
+      fd_ = -1;
+      return;
+    }
+  }
+  buf_.resize(kReadBuf);
+}
+
+FileReader::~FileReader(){ close(); }
+
+void FileReader::close(){
+  if(map_){ munmap(const_cast<char*>(map_), map_len_); map_ = nullptr; }
+  if(fd_ >= 0){ ::close(fd_); fd_ = -1; }
+  pos_ = end_ = size_ = 0;
+  ok_ = false;
+}
+
+// Refill the buffer; false at end of file (or on a read error).
+bool FileReader::fill(){
+  if(fd_ < 0) return false;
+  pos_ = 0;
+  ssize_t r = read_some(fd_, buf_.data(), buf_.size());
+  end_ = r > 0 ? (size_t)r : 0;
+  return end_ > 0;
+}
+
+bool FileReader::read_line(std::string& line){
+  line.clear();
+  if(map_){
+    if(pos_ >= size_) return false;
+    const char* p = map_ + pos_;
+    const char* nl = nullptr;
+    if(!map_scan(p, size_ - pos_, &nl)){ size_ = pos_; return false; }   // truncated: ends here
+    size_t len = nl ? (size_t)(nl - p) : size_ - pos_;
+    line.resize(len);   // allocate outside the guard
+    if(len && !map_copy(&line[0], p, len)){ line.clear(); size_ = pos_; return false; }
+    pos_ += len + (nl ? 1 : 0);
+    return true;
+  }
+  bool got = false;
+  for(;;){
+    if(pos_ == end_ && !fill()) return got;
+    got = true;
+    const char* p = buf_.data() + pos_;
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', end_ - pos_));
+    if(nl){
+      line.append(p, (size_t)(nl - p));
+      pos_ += (size_t)(nl - p) + 1;
+      return true;
+    }
+    line.append(p, end_ - pos_);   // the line continues in the next block
+    pos_ = end_;
+  }
+}
+
+bool FileReader::eof(){
+  if(map_){
+    char c;
+    if(pos_ < size_ && !map_copy(&c, map_ + pos_, 1)) size_ = pos_;
+    return pos_ >= size_;
+  }
+  return pos_ == end_ && !fill();
+}
+
+// ---- writers ---------------------------------------------------------------------
+
+static constexpr size_t kWriteBuf = size_t(64) << 10;
+
+static std::mutex g_writers_mu;
+static std::set<FileWriter*> g_writers;   // open writers, for writers_flush_all()
+
+static bool write_all(int fd, const char* data, size_t n){
+  while(n){
+    ssize_t w = ::write(fd, data, n);
+    if(w < 0){
+      if(errno == EINTR) continue;
+      return false;
+    }
+    data += w; n -= (size_t)w;
+  }
+  return true;
+}
+
+FileWriter::FileWriter(const std::string& path, bool append, Sync sync) : sync_(sync) {
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+  fd_ = ::open(path.c_str(), flags, 0666);
+  if(fd_ < 0) return;
+  buf_.reserve(kWriteBuf);
+  std::lock_guard<std::mutex> lk(g_writers_mu);
+  g_writers.insert(this);
+}
+
+FileWriter::~FileWriter(){
+  (void)close();
+  std::lock_guard<std::mutex> lk(g_writers_mu);
+  g_writers.erase(this);
+}
+
+bool FileWriter::drain_locked(){
+  if(fd_ < 0) return !failed_;
+  if(!buf_.empty() && !write_all(fd_, buf_.data(), buf_.size())) failed_ = true;
+  buf_.clear();
+  return !failed_;
+}
+
+bool FileWriter::write(const char* data, size_t n){
+  std::lock_guard<std::mutex> lk(mu_);
+  if(fd_ < 0) return false;
+  if(buf_.size() + n > kWriteBuf){
+    drain_locked();
+    if(n >= kWriteBuf){ if(!write_all(fd_, data, n)) failed_ = true; n = 0; }
+  }
+  buf_.append(data, n);
+  if(sync_ == SyncEachWrite){
+    drain_locked();
+    if(fdatasync(fd_) != 0) failed_ = true;
+  }
+  return !failed_;
+}
+
+bool FileWriter::flush(){
+  std::lock_guard<std::mutex> lk(mu_);
+  return drain_locked();
+}
+
+bool FileWriter::close(){
+  std::lock_guard<std::mutex> lk(mu_);
+  if(fd_ < 0) return !failed_;
+  drain_locked();
+  if(sync_ != NoSync && fsync(fd_) != 0) failed_ = true;
+  if(::close(fd_) != 0) failed_ = true;
+  fd_ = -1;
+  return !failed_;
+}
+
+void writers_flush_all(){
+  std::lock_guard<std::mutex> lk(g_writers_mu);
+  for(FileWriter* w : g_writers) (void)w->flush();
+}
+
+// ---- FS.Append's fd cache ---------------------------------------------------------
+
+namespace {
+struct AppendFd {
+  std::string path;
+  int fd;
+  dev_t dev;
+  ino_t ino;
+};
+}
+
+static constexpr size_t kAppendFds = 8;
+static std::mutex g_append_mu;
+static std::vector<AppendFd> g_append;   // most recently used first
+
+bool append_file(const std::string& path, const std::string& text){
+  std::lock_guard<std::mutex> lk(g_append_mu);
+  struct stat st{};
+  bool exists = ::stat(path.c_str(), &st) == 0;
+  auto it = std::find_if(g_append.begin(), g_append.end(), [&](const AppendFd& a){ return a.path == path; });
+  if(it != g_append.end() && (!exists || it->dev != st.st_dev || it->ino != st.st_ino)){
+    ::close(it->fd);   // the path names another file now
+    g_append.erase(it);
+    it = g_append.end();
+  }
+  if(it == g_append.end()){
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if(fd < 0) return false;
+    if(fstat(fd, &st) != 0){ ::close(fd); return false; }
+    if(g_append.size() >= kAppendFds){ ::close(g_append.back().fd); g_append.pop_back(); }
+    g_append.insert(g_append.begin(), AppendFd{path, fd, st.st_dev, st.st_ino});
+  } else if(it != g_append.begin()){
+    std::rotate(g_append.begin(), it, it + 1);
+  }
+  return write_all(g_append.front().fd, text.data(), text.size());
+}
+
+void append_cache_forget(const std::string& path){
+  std::lock_guard<std::mutex> lk(g_append_mu);
+  for(auto it = g_append.begin(); it != g_append.end();){
+    if(path.empty() || it->path == path){ ::close(it->fd); it = g_append.erase(it); }
+    else ++it;
+  }
+}
+
+#else  // _WIN32: iostreams
+
+bool read_file(const std::string& path, std::string& out){
+  std::ifstream f(path, std::ios::binary);
+  if(!f) return false;
+  out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  return true;
+}
+
+FileReader::FileReader(const std::string& path){
+  std::ifstream f(path, std::ios::binary);
+  if(!f) return;
+  ok_ = true;
+  buf_.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  end_ = buf_.size();
+}
+FileReader::~FileReader() = default;
+void FileReader::close(){ buf_.clear(); pos_ = end_ = 0; ok_ = false; }
+bool FileReader::fill(){ return false; }
+bool FileReader::read_line(std::string& line){
+  line.clear();
+  if(pos_ >= end_) return false;
+  auto nl = std::find(buf_.begin() + pos_, buf_.begin() + end_, '\n');
+  line.assign(buf_.begin() + pos_, nl);
+  pos_ = (size_t)(nl - buf_.begin()) + (nl != buf_.begin() + end_ ? 1 : 0);
+  return true;
+}
+bool FileReader::eof(){ return pos_ >= end_; }
+
+// Windows: unbuffered ofstream writes, no sync and no append cache.
+FileWriter::FileWriter(const std::string& path, bool append, Sync sync) : sync_(sync) {
+  std::ofstream f(path, append ? std::ios::app : std::ios::trunc);
+  if(f) fd_ = 0;
+  buf_ = path;
+}
+FileWriter::~FileWriter() = default;
+bool FileWriter::drain_locked(){ return true; }
+bool FileWriter::write(const char* data, size_t n){
+  if(fd_ < 0) return false;
+  std::ofstream f(buf_, std::ios::app | std::ios::binary);
+  f.write(data, (std::streamsize)n);
+  return (bool)f;
+}
+bool FileWriter::flush(){ return fd_ >= 0; }
+bool FileWriter::close(){ fd_ = -1; return true; }
+void writers_flush_all(){}
+bool append_file(const std::string& path, const std::string& text){
+  std::ofstream f(path, std::ios::app | std::ios::binary);
+  if(f) f << text;
+  return (bool)f;
+}
+void append_cache_forget(const std::string&){}
+
+#endif
+
+// ---- batched reads and stats ------------------------------------------------------
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PB_HAVE_URING 1
+
+namespace {
+// Minimal io_uring (no liburing): one submission and one completion ring.
+// run() keeps up to `entries` requests in flight, submitting and reaping in
+// the same io_uring_enter() call.
+class Uring {
+public:
+  explicit Uring(unsigned entries){
+    io_uring_params p{};
+    fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if(fd_ < 0) return;
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single) sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    sq_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_ = single ? sq_ : mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if(sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes == MAP_FAILED){
+      if(sqes != MAP_FAILED) munmap(sqes, sqes_len_);
+      unmap_rings();
+      ::close(fd_);
+      fd_ = -1;
+      return;
+    }
+    char* sq = static_cast<char*>(sq_);
+    char* cq = static_cast<char*>(cq_);
+    sq_head_  = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_  = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cq_head_  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_  = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_     = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    sqes_     = static_cast<io_uring_sqe*>(sqes);
+    entries_  = p.sq_entries;
+  }
+  ~Uring(){
+    if(fd_ < 0) return;
+    munmap(sqes_, sqes_len_);
+    unmap_rings();
+    ::close(fd_);
+  }
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+
+  bool ok() const { return fd_ >= 0; }
+
+  // All of `ops` implemented by this kernel (OPENAT/STATX need 5.6).
+  bool supports(std::initializer_list<int> ops){
+    std::vector<char> mem(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(mem.data());
+    if(syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+    for(int op : ops)
+      if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    return true;
+  }
+
+  // prep(i, sqe) fills request i; done(i, res) gets its result. False if the
+  // ring itself failed (requests may then be left unfinished).
+  template <class Prep, class Done>
+  bool run(size_t n, Prep&& prep, Done&& done){
+    size_t next = 0, queued = 0, inflight = 0;
+    while(next < n || queued || inflight){
+      while(next < n && queued + inflight < entries_){
+        unsigned tail = *sq_tail_;
+        unsigned idx = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof *sqe);
+        prep(next, sqe);
+        sqe->user_data = next;
+        sq_array_[idx] = idx;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++next; ++queued;
+      }
+      int rc = (int)syscall(__NR_io_uring_enter, fd_, (unsigned)queued, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+      if(rc < 0){
+        if(errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+      } else {
+        queued -= (size_t)rc;
+        inflight += (size_t)rc;
+      }
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for(; head != tail; ++head, --inflight){
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        done((size_t)cqe.user_data, cqe.res);
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return true;
+  }
+
+private:
+  void unmap_rings(){
+    if(sq_ != MAP_FAILED && sq_) munmap(sq_, sq_len_);
+    if(cq_ != sq_ && cq_ != MAP_FAILED && cq_) munmap(cq_, cq_len_);
+  }
+
+  int fd_{-1};
+  void* sq_{nullptr};
+  void* cq_{nullptr};
+  size_t sq_len_{0}, cq_len_{0}, sqes_len_{0};
+  unsigned *sq_head_{}, *sq_tail_{}, *sq_array_{}, *cq_head_{}, *cq_tail_{};
+  unsigned sq_mask_{0}, cq_mask_{0}, entries_{0};
+  io_uring_sqe* sqes_{nullptr};
+  io_uring_cqe* cqes_{nullptr};
+};
+
+unsigned ring_size(size_t n){ return (unsigned)std::min<size_t>(std::max<size_t>(n, 8), 256); }
+
+void prep_statx(io_uring_sqe* sqe, const std::string& path, struct statx* out){
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uint64_t)(uintptr_t)path.c_str();
+  sqe->len = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+  sqe->off = (uint64_t)(uintptr_t)out;
+}
+
+FileStat from_statx(const struct statx& sx){
+  FileStat st;
+  st.ok = true;
+  st.kind = S_ISREG(sx.stx_mode) ? 'f' : S_ISDIR(sx.stx_mode) ? 'd' : 'o';
+  st.size = sx.stx_size;
+  st.mtime = sx.stx_mtime.tv_sec;
+  return st;
+}
+
+bool uring_stat_many(const std::vector<std::string>& paths, std::vector<FileStat>& out){
+  Uring ring(ring_size(paths.size()));
+  if(!ring.ok() || !ring.supports({IORING_OP_STATX})) return false;
+  std::vector<struct statx> sx(paths.size());
+  std::vector<int> res(paths.size(), -1);
+  if(!ring.run(paths.size(),
+               [&](size_t i, io_uring_sqe* sqe){ prep_statx(sqe, paths[i], &sx[i]); },
+               [&](size_t i, int r){ res[i] = r; }))
+    return false;
+  out.assign(paths.size(), FileStat{});
+  for(size_t i=0;i<paths.size();++i) if(res[i] == 0) out[i] = from_statx(sx[i]);
+  return true;
+}
+
+// Three rounds: open + statx every path, read every regular file in one
+// request of its size (again for short reads), close everything.
+bool uring_read_many(const std::vector<std::string>& paths, std::vector<std::string>& out, std::vector<char>& ok){
+  const size_t n = paths.size();
+  Uring ring(ring_size(2 * n));
+  if(!ring.ok() || !ring.supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE}))
+    return false;
+  std::vector<int> fds(n, -1), sres(n, -1);
+  std::vector<struct statx> sx(n);
+  bool ran = ring.run(2 * n,
+    [&](size_t k, io_uring_sqe* sqe){
+      const std::string& path = paths[k / 2];
+      if(k % 2){ prep_statx(sqe, path, &sx[k / 2]); return; }
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uint64_t)(uintptr_t)path.c_str();
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    },
+    [&](size_t k, int r){ (k % 2 ? sres : fds)[k / 2] = r; });
+
+  std::vector<size_t> got(n, 0), todo;
+  for(size_t i=0;i<n && ran;++i){
+    if(fds[i] < 0) continue;
+    ok[i] = 1;
+    if(sres[i] == 0 && S_ISREG(sx[i].stx_mode) && sx[i].stx_size > 0){
+      out[i].resize((size_t)sx[i].stx_size);
+      todo.push_back(i);
+    } else {
+      // no size to go by (/proc, pipes): plain reads
+      for(;;){
+        out[i].resize(got[i] + 65536);
+        ssize_t r = read_some(fds[i], &out[i][got[i]], 65536);
+        if(r < 0) ok[i] = 0;
+        if(r <= 0) break;
+        got[i] += (size_t)r;
+      }
+    }
+  }
+  while(ran && !todo.empty()){
+    std::vector<size_t> again;
+    ran = ring.run(todo.size(),
+      [&](size_t k, io_uring_sqe* sqe){
+        size_t i = todo[k];
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fds[i];
+        sqe->addr = (uint64_t)(uintptr_t)(out[i].data() + got[i]);
+        sqe->len = (unsigned)std::min<size_t>(out[i].size() - got[i], 1u << 30);
+        sqe->off = got[i];
+      },
+      [&](size_t k, int r){
+        size_t i = todo[k];
+        if(r < 0){ ok[i] = 0; return; }
+        got[i] += (size_t)r;
+        if(r > 0 && got[i] < out[i].size()) again.push_back(i);   // short read (or a file that shrank)
+      });
+    todo.swap(again);
+  }
+  for(size_t i=0;i<n;++i) out[i].resize(got[i]);
+
+  std::vector<size_t> open;
+  for(size_t i=0;i<n;++i) if(fds[i] >= 0) open.push_back(i);
+  (void)ring.run(open.size(),
+    [&](size_t k, io_uring_sqe* sqe){ sqe->opcode = IORING_OP_CLOSE; sqe->fd = fds[open[k]]; },
+    [&](size_t k, int){ fds[open[k]] = -1; });
+  for(int fd : fds) if(fd >= 0) ::close(fd);   // the ring failed part way
+  return ran;
+}
+}
+#endif
+
+static constexpr unsigned kIoThreads = 16;   // blocking I/O: more threads than cores
+
+std::vector<FileStat> stat_many(const std::vector<std::string>& paths){
+  std::vector<FileStat> out;
+#ifdef PB_HAVE_URING
+  if(uring_stat_many(paths, out)) return out;
+#endif
+  out.assign(paths.size(), FileStat{});
+  parallel_for(paths.size(), [&](size_t i){
+#ifndef _WIN32
+    struct stat st{};
+    if(::stat(paths[i].c_str(), &st) != 0) return;
+    FileStat& r = out[i];
+    r.ok = true;
+    r.kind = S_ISREG(st.st_mode) ? 'f' : S_ISDIR(st.st_mode) ? 'd' : 'o';
+    r.size = (uint64_t)st.st_size;
+    r.mtime = (int64_t)st.st_mtime;
+#else
+    std::error_code ec;
+    auto s = std::filesystem::status(paths[i], ec);
+    if(ec || !std::filesystem::exists(s)) return;
+    FileStat& r = out[i];
+    r.ok = true;
+    r.kind = std::filesystem::is_regular_file(s) ? 'f' : std::filesystem::is_directory(s) ? 'd' : 'o';
+    if(r.kind == 'f') r.size = (uint64_t)std::filesystem::file_size(paths[i], ec);
+#endif
+  }, kIoThreads);
+  return out;
+}
+
+std::vector<std::string> read_many(const std::vector<std::string>& paths, std::vector<bool>* ok){
+  std::vector<std::string> out(paths.size());
+  std::vector<char> good(paths.size(), 0);   // not vector<bool>: written from several threads
+  bool done = false;
+#ifdef PB_HAVE_URING
+  done = uring_read_many(paths, out, good);
+#endif
+  if(!done){
+    std::fill(good.begin(), good.end(), 0);
+    parallel_for(paths.size(), [&](size_t i){ good[i] = read_file(paths[i], out[i]) ? 1 : 0; }, kIoThreads);
+  }
+  if(ok) ok->assign(good.begin(), good.end());
+  return out;
+}
+
+// ---- recursive walk ----------------------------------------------------------------
+
+static bool walk_match(const WalkOptions& opt, char kind, const char* name){
+  if(opt.type && opt.type != kind) return false;
+  if(opt.names.empty()) return true;
+#ifndef _WIN32
+  for(const auto& pat : opt.names) if(fnmatch(pat.c_str(), name, 0) == 0) return true;
+#else
+  for(const auto& pat : opt.names) if(pat == name) return true;   // no fnmatch: exact names
+#endif
+  return false;
+}
+
+static std::string walk_join(const std::string& dir, const char* name){
+  std::string p = dir;
+  if(p.empty() || p.back() != '/') p += '/';
+  return p += name;
+}
+
+// Walk `root`, handing each directory's matches to `emit` as they are read;
+// `emit` may be called from several threads at once and returns false to stop
+// the walk.
+using WalkEmit = std::function<bool(std::vector<std::string>&)>;
+
+#ifdef __linux__
+
+namespace {
+struct WalkDir {
+  std::string path;
+  int depth;   // depth of the entries inside it
+};
+
+// Directories wait on a shared stack (depth-first keeps it short); each
+// worker reads one with getdents64, emits its entries and pushes the
+// subdirectories back.
+class Walker {
+public:
+  Walker(const WalkOptions& opt, const WalkEmit& emit) : opt_(opt), emit_(emit) {}
+
+  void run(const std::string& root){
+    stack_.push_back(WalkDir{root, 1});
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t nthreads = std::clamp<size_t>(2 * hw, 4, 16);   // mostly waiting on the disk
+    std::vector<std::thread> pool;
+    for(size_t i=1;i<nthreads;++i) pool.emplace_back([this]{ work(); });
+    work();
+    for(auto& t : pool) t.join();
+  }
+
+private:
+  void work(){
+    std::vector<char> buf(size_t(64) << 10);
+    std::vector<std::string> out;
+    std::vector<WalkDir> sub;
+    for(;;){
+      WalkDir d;
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&]{ return stop_ || !stack_.empty() || busy_ == 0; });
+        if(stop_ || stack_.empty()) return;   // stopped, or nothing queued and nobody left to queue more
+        d = std::move(stack_.back());
+        stack_.pop_back();
+        ++busy_;
+      }
+      scan(d, buf, out, sub);
+      bool more = out.empty() || emit_(out);
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        if(!more) stop_ = true;
+        for(auto& s : sub) stack_.push_back(std::move(s));
+        --busy_;
+      }
+      out.clear();
+      sub.clear();
+      cv_.notify_all();
+    }
+  }
+
+  // With symlinks followed, a directory reachable twice is read once.
+  bool first_visit(int fd){
+    struct stat st{};
+    if(fstat(fd, &st) != 0) return false;
+    std::lock_guard<std::mutex> lk(mu_);
+    return seen_.insert({st.st_dev, st.st_ino}).second;
+  }
+
+  void scan(const WalkDir& d, std::vector<char>& buf, std::vector<std::string>& out, std::vector<WalkDir>& sub){
+    int fd = ::open(d.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) return;
+    if(opt_.follow && !first_visit(fd)){ ::close(fd); return; }
+    const bool deeper = opt_.max_depth < 0 || d.depth < opt_.max_depth;
+    for(;;){
+      long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+      if(n <= 0) break;
+      for(long off = 0; off < n;){
+        const auto* e = reinterpret_cast<const struct dirent64*>(buf.data() + off);
+        off += e->d_reclen;
+        const char* name = e->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        if(name[0] == '.' && !opt_.hidden) continue;
+
+        char kind;
+        switch(e->d_type){
+          case DT_DIR: kind = 'd'; break;
+          case DT_REG: kind = 'f'; break;
+          case DT_LNK: kind = 'l'; break;
+          case DT_UNKNOWN: {   // some filesystems leave it to us
+            struct stat st{};
+            if(fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            kind = S_ISDIR(st.st_mode) ? 'd' : S_ISREG(st.st_mode) ? 'f' : S_ISLNK(st.st_mode) ? 'l' : 'o';
+          } break;
+          default: kind = 'o';
+        }
+        if(kind == 'l' && opt_.follow){
+          struct stat st{};
+          if(fstatat(fd, name, &st, 0) == 0) kind = S_ISDIR(st.st_mode) ? 'd' : S_ISREG(st.st_mode) ? 'f' : 'o';
+        }
+        bool match = walk_match(opt_, kind, name);
+        bool descend = kind == 'd' && deeper;
+        if(!match && !descend) continue;
+        std::string path = walk_join(d.path, name);
+        if(descend) sub.push_back(WalkDir{match ? path : std::move(path), d.depth + 1});
+        if(match) out.push_back(std::move(path));
+      }
+    }
+    ::close(fd);
+  }
+
+  const WalkOptions& opt_;
+  const WalkEmit& emit_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<WalkDir> stack_;
+  size_t busy_{0};
+  bool stop_{false};
+  std::set<std::pair<dev_t, ino_t>> seen_;
+};
+}
+
+static bool walk_root_ok(const std::string& root){
+  struct stat st{};
+  return ::stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void walk_each(const std::string& root, const WalkOptions& opt, const WalkEmit& emit){
+  if(opt.max_depth == 0 || !walk_root_ok(root)) return;
+  Walker(opt, emit).run(root);
+}
+
+#else  // portable: std::filesystem, one thread
+
+static bool walk_root_ok(const std::string& root){
+  std::error_code ec;
+  return std::filesystem::is_directory(root, ec);
+}
+
+static void walk_each(const std::string& root, const WalkOptions& opt, const WalkEmit& emit){
+  namespace fs = std::filesystem;
+  if(opt.max_depth == 0) return;
+  std::vector<std::string> out;
+  std::error_code ec;
+  auto flags = fs::directory_options::skip_permission_denied;
+  if(opt.follow) flags |= fs::directory_options::follow_directory_symlink;
+  for(fs::recursive_directory_iterator it(root, flags, ec), end; !ec && it != end; it.increment(ec)){
+    std::string name = it->path().filename().string();
+    bool dir = it->is_directory(ec);
+    if(name[0] == '.' && !opt.hidden){ if(dir) it.disable_recursion_pending(); continue; }
+    if(opt.max_depth >= 0 && it.depth() + 1 >= opt.max_depth) it.disable_recursion_pending();
+    char kind = (!opt.follow && it->is_symlink(ec)) ? 'l' : dir ? 'd' : it->is_regular_file(ec) ? 'f' : 'o';
+    if(!walk_match(opt, kind, name.c_str())) continue;
+    out.push_back(walk_join(root, fs::relative(it->path(), root, ec).string().c_str()));
+    if(out.size() >= 256){ if(!emit(out)) return; out.clear(); }
+  }
+  if(!out.empty()) (void)emit(out);
+}
+
+#endif
+
+std::vector<std::string> walk_tree(const std::string& root, const WalkOptions& opt){
+  std::mutex mu;
+  std::vector<std::string> out;
+  walk_each(root, opt, [&](std::vector<std::string>& batch){
+    std::lock_guard<std::mutex> lk(mu);
+    out.insert(out.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+    return true;
+  });
+  if(opt.sort) std::sort(out.begin(), out.end());
+  return out;
+}
+
+struct WalkStream::State {
+  WalkOptions opt;
+  bool ok{false};
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<std::string> queue;
+  bool done{false}, stop{false};
+  std::thread thread;
+};
+
+static constexpr size_t kWalkQueueMax = size_t(64) << 10;
+
+WalkStream::WalkStream(const std::string& root, const WalkOptions& opt) : st_(new State) {
+  st_->opt = opt;
+  st_->ok = walk_root_ok(root);
+  State* st = st_.get();
+  st->thread = std::thread([st, root]{
+    walk_each(root, st->opt, [st](std::vector<std::string>& batch){
+      std::unique_lock<std::mutex> lk(st->mu);
+      st->cv.wait(lk, [st]{ return st->stop || st->queue.size() < kWalkQueueMax; });
+      if(st->stop) return false;
+      for(auto& p : batch) st->queue.push_back(std::move(p));
+      st->cv.notify_all();
+      return true;
+    });
+    std::lock_guard<std::mutex> lk(st->mu);
+    st->done = true;
+    st->cv.notify_all();
+  });
+}
+
+WalkStream::~WalkStream(){
+  {
+    std::lock_guard<std::mutex> lk(st_->mu);
+    st_->stop = true;
+  }
+  st_->cv.notify_all();
+  st_->thread.join();
+}
+
+bool WalkStream::ok() const { return st_->ok; }
+
+bool WalkStream::next(std::string& path){
+  std::unique_lock<std::mutex> lk(st_->mu);
+  st_->cv.wait(lk, [this]{ return st_->done || !st_->queue.empty(); });
+  if(st_->queue.empty()) return false;
+  path = std::move(st_->queue.front());
+  st_->queue.pop_front();
+  st_->cv.notify_all();   // a walker may be waiting for room
+  return true;
+}
+
+bool WalkStream::eof(){
+  std::unique_lock<std::mutex> lk(st_->mu);
+  st_->cv.wait(lk, [this]{ return st_->done || !st_->queue.empty(); });
+  return st_->queue.empty();
+}
+
+} // namespace pb
@@ -0,0 +1,380 @@
+#include "prismshell/glob.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#ifndef _WIN32
+  #include <dirent.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#endif
+
+namespace pb {
+
+namespace fs = std::filesystem;
+
+// ---- directory listing cache ---------------------------------------------------------
+
+namespace {
+struct DirEntry {
+  std::string name;
+  bool dir{false};    // a directory, or a symlink to one
+  bool link{false};
+};
+using Listing = std::vector<DirEntry>;
+
+std::mutex g_cache_mu;
+std::unordered_map<std::string, std::shared_ptr<const Listing>> g_cache;   // dir -> entries
+std::string g_cache_cwd;   // relative keys are only valid in this directory
+int g_cache_scopes = 0;
+}
+
+GlobCacheScope::GlobCacheScope(){
+  std::lock_guard<std::mutex> lk(g_cache_mu);
+  ++g_cache_scopes;
+}
+
+GlobCacheScope::~GlobCacheScope(){
+  std::lock_guard<std::mutex> lk(g_cache_mu);
+  if(--g_cache_scopes == 0) g_cache.clear();
+}
+
+void glob_cache_invalidate(){
+  std::lock_guard<std::mutex> lk(g_cache_mu);
+  g_cache.clear();
+}
+
+static void cache_check_cwd(){
+  std::error_code ec;
+  std::string cwd = fs::current_path(ec).string();
+  std::lock_guard<std::mutex> lk(g_cache_mu);
+  if(cwd != g_cache_cwd){ g_cache.clear(); g_cache_cwd = std::move(cwd); }
+}
+
+// Entries of `dir` ("" is the working directory) without "." and "..";
+// empty if it cannot be read.
+static Listing read_dir(const std::string& dir){
+  Listing out;
+#ifndef _WIN32
+  DIR* d = ::opendir(dir.empty() ? "." : dir.c_str());
+  if(!d) return out;
+  int dfd = ::dirfd(d);
+  while(const struct dirent* e = ::readdir(d)){
+    const char* name = e->d_name;
+    if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+    DirEntry ent;
+    ent.name = name;
+    unsigned char type = e->d_type;
+    if(type == DT_UNKNOWN){   // some filesystems leave it to us
+      struct stat st{};
+      if(fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+    }
+    ent.link = type == DT_LNK;
+    ent.dir = type == DT_DIR;
+    if(ent.link){
+      struct stat st{};
+      ent.dir = fstatat(dfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+    }
+    out.push_back(std::move(ent));
+  }
+  ::closedir(d);
+#else
+  std::error_code ec;
+  for(fs::directory_iterator it(dir.empty() ? fs::path(".") : fs::path(dir), ec), end; !ec && it != end; it.increment(ec)){
+    DirEntry ent;
+    ent.name = it->path().filename().string();
+    ent.link = it->is_symlink(ec);
+    ent.dir = it->is_directory(ec);
+    out.push_back(std::move(ent));
+  }
+#endif
+  return out;
+}
+
+static std::shared_ptr<const Listing> list_dir(const std::string& dir){
+  {
+    std::lock_guard<std::mutex> lk(g_cache_mu);
+    auto it = g_cache.find(dir);
+    if(it != g_cache.end()) return it->second;
+  }
+  auto l = std::make_shared<const Listing>(read_dir(dir));
+  std::lock_guard<std::mutex> lk(g_cache_mu);
+  return g_cache.emplace(dir, std::move(l)).first->second;   // another thread's, if it was first
+}
+
+static bool path_exists(const std::string& path, bool dir_only){
+#ifndef _WIN32
+  struct stat st{};
+  if(dir_only) return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  return ::lstat(path.c_str(), &st) == 0;
+#else
+  std::error_code ec;
+  return dir_only ? fs::is_directory(path, ec) : fs::exists(fs::symlink_status(path, ec));
+#endif
+}
+
+// ---- patterns ---------------------------------------------------------------------
+
+// Bytes in the UTF-8 character at `s` (1 for stray bytes).
+static size_t utf8_len(const char* s){
+  unsigned char c = (unsigned char)*s;
+  size_t n = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : 1;
+  for(size_t i=1;i<n;++i) if(((unsigned char)s[i] & 0xC0) != 0x80) return 1;
+  return n;
+}
+
+bool glob_has_magic(const std::string& s){
+  for(size_t i=0;i<s.size();++i){
+    char c = s[i];
+    if(c == '\\'){ ++i; continue; }
+    if(c == '*' || c == '?' || c == '[') return true;
+  }
+  return false;
+}
+
+// a{b,c{d,e}}f -> abf acdf acef. A brace pair without a top-level comma is
+// literal, as in bash.
+static void brace_expand(const std::string& s, std::vector<std::string>& out){
+  for(size_t i=0;i<s.size();++i){
+    if(s[i] == '\\'){ ++i; continue; }
+    if(s[i] != '{') continue;
+    int depth = 0;
+    size_t close = std::string::npos;
+    std::vector<size_t> commas;
+    for(size_t j=i+1;j<s.size();++j){
+      char c = s[j];
+      if(c == '\\'){ ++j; continue; }
+      if(c == '{') ++depth;
+      else if(c == '}'){ if(depth == 0){ close = j; break; } --depth; }
+      else if(c == ',' && depth == 0) commas.push_back(j);
+    }
+    if(close == std::string::npos || commas.empty()) continue;
+    std::string pre = s.substr(0, i), post = s.substr(close + 1);
+    commas.push_back(close);
+    size_t start = i + 1;
+    for(size_t c : commas){
+      brace_expand(pre + s.substr(start, c - start) + post, out);
+      start = c + 1;
+    }
+    return;
+  }
+  out.push_back(s);
+}
+
+namespace {
+struct Tok {
+  enum Kind : unsigned char { Char, Any, Star, Set } kind{Char};
+  char c{0};
+  bool neg{false};
+  std::bitset<256> set;
+};
+
+struct Segment {
+  enum Kind { Literal, Pattern, AnyDirs } kind{Literal};
+  std::string text;        // Literal: the name, unescaped
+  std::vector<Tok> toks;   // Pattern
+  bool dot{false};         // starts with a literal '.': may match hidden names
+};
+
+void add_class(std::bitset<256>& set, const std::string& name){
+  int (*pred)(int) = nullptr;
+  if(name == "alpha") pred = ::isalpha;
+  else if(name == "digit") pred = ::isdigit;
+  else if(name == "alnum") pred = ::isalnum;
+  else if(name == "upper") pred = ::isupper;
+  else if(name == "lower") pred = ::islower;
+  else if(name == "space") pred = ::isspace;
+  else if(name == "blank") pred = ::isblank;
+  else if(name == "punct") pred = ::ispunct;
+  else if(name == "xdigit") pred = ::isxdigit;
+  else if(name == "cntrl") pred = ::iscntrl;
+  else if(name == "print") pred = ::isprint;
+  else if(name == "graph") pred = ::isgraph;
+  if(pred) for(int c=0;c<128;++c) if(pred(c)) set.set((size_t)c);
+}
+
+// `[...]` starting at s[i]; on success fills `out` and moves i to the ']'.
+// False if there is no closing bracket (then '[' is an ordinary character).
+bool parse_set(const std::string& s, size_t& i, Tok& out){
+  size_t j = i + 1;
+  Tok t;
+  t.kind = Tok::Set;
+  if(j < s.size() && (s[j] == '!' || s[j] == '^')){ t.neg = true; ++j; }
+  bool first = true;
+  for(; j < s.size(); first = false){
+    unsigned char c = (unsigned char)s[j];
+    if(c == ']' && !first){ i = j; out = std::move(t); return true; }
+    if(c == '[' && j + 1 < s.size() && s[j+1] == ':'){
+      size_t end = s.find(":]", j + 2);
+      if(end != std::string::npos){ add_class(t.set, s.substr(j + 2, end - j - 2)); j = end + 2; continue; }
+    }
+    if(c == '\\' && j + 1 < s.size()) c = (unsigned char)s[++j];
+    ++j;
+    if(j + 1 < s.size() && s[j] == '-' && s[j+1] != ']'){
+      unsigned char hi = (unsigned char)s[j+1];
+      size_t next = j + 2;
+      if(hi == '\\' && j + 2 < s.size()){ hi = (unsigned char)s[j+2]; next = j + 3; }
+      for(unsigned v = c; v <= hi; ++v) t.set.set(v);
+      j = next;
+    } else {
+      t.set.set(c);
+    }
+  }
+  return false;
+}
+
+Segment compile_segment(const std::string& s, const GlobOptions& opt){
+  Segment seg;
+  if(s == "**" && opt.globstar){ seg.kind = Segment::AnyDirs; return seg; }
+  bool magic = false;
+  for(size_t i=0;i<s.size();++i){
+    char c = s[i];
+    Tok t;
+    if(c == '\\' && i + 1 < s.size()) t.c = s[++i];
+    else if(c == '*'){
+      magic = true;
+      if(!seg.toks.empty() && seg.toks.back().kind == Tok::Star) continue;
+      t.kind = Tok::Star;
+    }
+    else if(c == '?'){ magic = true; t.kind = Tok::Any; }
+    else if(c == '[' && parse_set(s, i, t)) magic = true;
+    else t.c = c;
+    seg.toks.push_back(std::move(t));
+  }
+  seg.dot = !seg.toks.empty() && seg.toks[0].kind == Tok::Char && seg.toks[0].c == '.';
+  if(!magic){
+    for(const Tok& t : seg.toks) seg.text.push_back(t.c);
+    seg.toks.clear();
+  } else {
+    seg.kind = Segment::Pattern;
+  }
+  return seg;
+}
+
+// Bytes of `s` that token `t` consumes, 0 if it does not match there.
+size_t step(const Tok& t, const char* s){
+  switch(t.kind){
+    case Tok::Char: return *s == t.c ? 1 : 0;
+    case Tok::Any:  return utf8_len(s);
+    case Tok::Set:  return t.set.test((unsigned char)*s) != t.neg ? utf8_len(s) : 0;
+    default:        return 0;
+  }
+}
+
+// Wildcard match, backtracking only to the last `*` seen: linear for the
+// usual patterns, never exponential.
+bool match(const std::vector<Tok>& p, const char* s){
+  size_t pi = 0, star = std::string::npos;
+  const char* mark = nullptr;
+  while(*s){
+    if(pi < p.size()){
+      if(p[pi].kind == Tok::Star){ star = ++pi; mark = s; continue; }
+      if(size_t n = step(p[pi], s)){ s += n; ++pi; continue; }
+    }
+    if(star == std::string::npos) return false;
+    pi = star;
+    mark += utf8_len(mark);
+    s = mark;
+  }
+  while(pi < p.size() && p[pi].kind == Tok::Star) ++pi;
+  return pi == p.size();
+}
+
+// One brace-free pattern: segments are expanded left to right below a path
+// prefix ("" relative, or ending in '/').
+class Glob {
+public:
+  Glob(const std::string& pattern, const GlobOptions& opt, std::vector<std::string>& out) : out_(out) {
+    size_t i = 0;
+    if(pattern[0] == '/'){ root_ = "/"; i = 1; }
+    dir_only_ = pattern.back() == '/';
+    while(i < pattern.size()){
+      size_t slash = pattern.find('/', i);
+      if(slash == std::string::npos) slash = pattern.size();
+      if(slash > i){
+        Segment seg = compile_segment(pattern.substr(i, slash - i), opt);
+        bool repeat = seg.kind == Segment::AnyDirs && !segs_.empty() && segs_.back().kind == Segment::AnyDirs;
+        if(!repeat) segs_.push_back(std::move(seg));
+      }
+      i = slash + 1;
+    }
+  }
+
+  void run(){
+    if(segs_.empty()){ if(!root_.empty()) out_.push_back(root_); return; }
+    expand(0, root_);
+  }
+
+private:
+  void emit(std::string path, bool dir){
+    if(dir_only_ && !dir) return;
+    if(dir_only_) path += '/';
+    out_.push_back(std::move(path));
+  }
+
+  void expand(size_t k, std::string prefix){
+    // literal segments: no listing needed
+    while(k + 1 < segs_.size() && segs_[k].kind == Segment::Literal){
+      prefix += segs_[k++].text;
+      prefix += '/';
+    }
+    const Segment& seg = segs_[k];
+    const bool last = k + 1 == segs_.size();
+    if(seg.kind == Segment::Literal){
+      std::string path = prefix + seg.text;
+      if(path_exists(path, dir_only_)) emit(std::move(path), dir_only_);
+      return;
+    }
+    if(seg.kind == Segment::AnyDirs){ any_dirs(k, prefix); return; }
+
+    auto entries = list_dir(prefix);
+    for(const DirEntry& e : *entries){
+      if(e.name[0] == '.' && !seg.dot) continue;
+      if(!match(seg.toks, e.name.c_str())) continue;
+      if(last) emit(prefix + e.name, e.dir);
+      else if(e.dir) expand(k + 1, prefix + e.name + '/');
+    }
+  }
+
+  // `**` at segs_[k]: the rest of the pattern below `prefix` and below every
+  // directory under it (a trailing `**` lists everything under it).
+  void any_dirs(size_t k, const std::string& prefix){
+    const bool last = k + 1 == segs_.size();
+    if(!last) expand(k + 1, prefix);
+    auto entries = list_dir(prefix);
+    for(const DirEntry& e : *entries){
+      if(e.name[0] == '.') continue;
+      if(last) emit(prefix + e.name, e.dir);
+      if(e.dir && !e.link) any_dirs(k, prefix + e.name + '/');
+    }
+  }
+
+  std::vector<std::string>& out_;
+  std::vector<Segment> segs_;
+  std::string root_;
+  bool dir_only_{false};
+};
+}
+
+std::vector<std::string> glob_expand(const std::string& pattern, const GlobOptions& opt){
+  std::vector<std::string> pats;
+  if(opt.braces) brace_expand(pattern, pats);
+  else pats.push_back(pattern);
+
+  GlobCacheScope scope;
+  cache_check_cwd();
+  std::vector<std::string> out;
+  for(const auto& p : pats) if(!p.empty()) Glob(p, opt, out).run();
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+} // namespace pb
@@ -1,21 +1,32 @@
 #include "prismshell/interpreter.hpp"
+#include "prismshell/mods.hpp"
+#include "prismshell/plugins.hpp"
+#include "prismshell/process.hpp"
 #include "prismshell/runtime.hpp"
 #include "prismshell/utils.hpp"
 
 #include <atomic>
 #include <cctype>
 #include <csignal>
+#include <cstring>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <set>
 #include <sstream>
 #include <string>
 #include <unordered_set>
 #include <vector>
 #include <chrono>
 #include <ctime>
+#include <deque>
+#include <future>
+#include <thread>
+#include <map>
+#include <unistd.h>
 
 #ifdef USE_READLINE
 extern "C" {
@@ -38,7 +49,13 @@ int  mod_run_capture(const std::string& name, const std::vector<std::string>& ar
 // ---------------- SIGINT (Ctrl-C) handling ----------------
 namespace {
   inline std::atomic_bool g_sigint{false};
-  void on_sigint(int){ g_sigint.store(true, std::memory_order_relaxed); }
+  // Stops the prompt mod render in flight (Runtime::cancel); Ctrl-C sets it
+  // too, since a render stuck in a loop would otherwise spin until exit.
+  inline std::atomic_bool g_prompt_stop{false};
+  void on_sigint(int){
+    g_sigint.store(true, std::memory_order_relaxed);
+    g_prompt_stop.store(true, std::memory_order_relaxed);
+  }
   void install_sig_handlers(){
     struct sigaction sa{}; sa.sa_handler = on_sigint; sigemptyset(&sa.sa_mask); sa.sa_flags = 0;
     sigaction(SIGINT, &sa, nullptr);
@@ -58,50 +75,28 @@ static bool is_integer_line(const std::string& s){
 
 static std::string to_upper(std::string s){ for(char& c: s) c=(char)std::toupper((unsigned char)c); return s; }
 
-static std::string json_escape(const std::string& in){
-  std::string out; out.reserve(in.size()+8);
-  for(unsigned char c: in){
-    switch(c){
-      case '\\': out += "\\\\"; break;
-      case '"' : out += "\\\""; break;
-      case '\b': out += "\\b"; break;
-      case '\f': out += "\\f"; break;
-      case '\n': out += "\\n"; break;
-      case '\r': out += "\\r"; break;
-      case '\t': out += "\\t"; break;
-      default:
-        if(c < 0x20){ char b[8]; std::snprintf(b,sizeof(b),"\\u%04x", c); out += b; }
-        else out += (char)c;
-    }
-  }
-  return out;
-}
-static std::string json_array(const std::vector<std::string>& xs){
-  std::ostringstream oss; oss << "[";
-  for(size_t i=0;i<xs.size();++i){ if(i) oss << ","; oss << "\"" << json_escape(xs[i]) << "\""; }
-  oss << "]"; return oss.str();
-}
-
-// shell-like tokenizer with quotes/escapes
-static std::vector<std::string> tokenize_quoted(const std::string& line){
-  std::vector<std::string> out; std::string cur;
+// Split "a | b | c" on unquoted pipes. False unless there are at least two
+// non-empty stages and no "||" (left to the shell).
+static bool split_pipeline(const std::string& line, std::vector<std::string>& stages){
+  stages.clear(); std::string cur;
   bool in_single=false, in_double=false, escaping=false;
-  auto push = [&](){ out.push_back(cur); cur.clear(); };
   for(size_t i=0;i<line.size();++i){
     char c=line[i];
     if(escaping){ cur.push_back(c); escaping=false; continue; }
-    if(c=='\\'){ if(in_single) cur.push_back(c); else escaping=true; continue; }
-    if(c=='\'' && !in_double){ in_single=!in_single; continue; }
-    if(c=='"' && !in_single){ in_double=!in_double; continue; }
-    if(std::isspace((unsigned char)c) && !in_single && !in_double){
-      if(!cur.empty()) push();
-      while(i+1<line.size() && std::isspace((unsigned char)line[i+1])) ++i;
+    if(c=='\\' && !in_single) escaping=true;
+    else if(c=='\'' && !in_double) in_single=!in_single;
+    else if(c=='"' && !in_single) in_double=!in_double;
+    else if(c=='|' && !in_single && !in_double){
+      if(i+1<line.size() && line[i+1]=='|') return false;
+      stages.push_back(trim(cur)); cur.clear();
       continue;
     }
     cur.push_back(c);
   }
-  if(!cur.empty() || (!in_single && !in_double && out.empty())) push();
-  return out;
+  stages.push_back(trim(cur));
+  if(stages.size() < 2) return false;
+  for(const auto& st : stages) if(st.empty()) return false;
+  return true;
 }
 
 // query runtime for registered mods via CALL Mod.List()
@@ -114,103 +109,6 @@ static std::vector<std::string> list_mod_names_via_call(Runtime& rt){
   return out;
 }
 
-// ---- MOD AUTOLOAD ---------------------------------------------------------
-static bool has_ext_ci(const fs::path& p, const std::vector<std::string>& exts){
-  auto e = p.extension().string();
-  std::string up; up.reserve(e.size());
-  for(char c: e) up.push_back((char)std::toupper((unsigned char)c));
-  for(const auto& want : exts){
-    if(up == want) return true;
-  }
-  return false;
-}
-
-static void load_mod_file(Runtime& rt, const fs::path& p){
-  std::ifstream f(p);
-  if(!f) return;
-  std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
-  // strip shebang if present
-  if(!content.empty() && content.rfind("#!", 0) == 0){
-    auto nl = content.find('\n');
-    content = (nl == std::string::npos) ? std::string() : content.substr(nl+1);
-  }
-  // numbered?
-  bool numbered = true;
-  {
-    std::istringstream iss(content); std::string line;
-    while(std::getline(iss, line)){
-      std::string t = trim(line); if(t.empty()) continue;
-      if(!std::isdigit((unsigned char)t[0])){ numbered=false; break; }
-    }
-  }
-  Runtime mrt; // child runtime to execute registration code
-  if(numbered){
-    std::istringstream iss2(content); std::string line;
-    while(std::getline(iss2, line)){
-      std::string t = trim(line); if(t.empty()) continue;
-      auto sp = t.find(' '); if(sp == std::string::npos) continue;
-      int n = std::stoi(t.substr(0, sp));
-      std::string src = trim(t.substr(sp+1));
-      mrt.program[n] = src;
-    }
-  } else {
-    std::istringstream iss2(content); std::string line; int n=10;
-    while(std::getline(iss2, line)){
-      std::string t = trim(line); if(t.empty()) continue;
-      mrt.program[n] = t; n += 10;
-    }
-  }
-  mrt.vars["PB_ARGV"] = std::string("[]");
-  auto r = mrt.run_program();
-  if(r.err){
-    std::cerr << "Mod load error in " << p << " at " << r.err->line << ": " << r.err->msg << "\n";
-  }
-}
-
-static std::vector<fs::path> mod_search_paths(){
-  std::vector<fs::path> roots;
-  // project-local (current dir)
-  roots.emplace_back(fs::path("mods"));
-  // user
-  if(const char* home = std::getenv("HOME")){
-    roots.emplace_back(fs::path(home) / ".config/prismshell/mods");
-  }
-  // system
-  roots.emplace_back(fs::path("/usr/local/share/prismshell/mods"));
-  roots.emplace_back(fs::path("/usr/share/prismshell/mods"));
-  // env PRISMSHELL_MOD_PATH (colon-separated)
-  if(const char* extra = std::getenv("PRISMSHELL_MOD_PATH")){
-    std::string s = extra;
-    size_t start=0;
-    while(true){
-      size_t sep = s.find(':', start);
-      std::string chunk = (sep==std::string::npos) ? s.substr(start) : s.substr(start, sep-start);
-      if(!chunk.empty()) roots.emplace_back(chunk);
-      if(sep==std::string::npos) break;
-      start = sep+1;
-    }
-  }
-  return roots;
-}
-
-static void autoload_mods(Runtime& rt){
-  // Try to clear registry if supported
-  (void)rt.run_line_direct("CALL Mod.Clear()", 0); // ignore errors if not implemented
-
-  std::vector<std::string> exts = { ".BAS", ".PBAS" };
-  for(const auto& root : mod_search_paths()){
-    std::error_code ec;
-    if(!fs::exists(root, ec) || !fs::is_directory(root, ec)) continue;
-    for(auto it = fs::directory_iterator(root, ec); !ec && it!=fs::end(it); it.increment(ec)){
-      if(!it->is_regular_file()) continue;
-      const auto& p = it->path();
-      if(has_ext_ci(p, exts)){
-        load_mod_file(rt, p);
-      }
-    }
-  }
-}
-
 // prompt building bits
 static std::string now_time_hhmmss(){
   using namespace std::chrono;
@@ -266,22 +164,137 @@ static std::string expand_template(std::string tmpl, int last_status){
   rep("time", now_time_hhmmss());
   return tmpl;
 }
-static std::string build_prompt(Runtime& rt, int last_status, const std::unordered_set<std::string>& disabled){
-  // 1) prompt mod
-  if(!disabled.count("prompt") && mod_has("prompt")){
-    std::string out;
-    int rc = mod_run_capture("prompt", {"--status", std::to_string(last_status)}, rt, &out);
-    if(rc==0 && !out.empty()) return out;
+// ---- prompt cache ----------------------------------------------------------
+// The rendered prompt is reused until one of its inputs changes: the prompt
+// epoch (cwd, template, mod registry, env), the last status, the template text
+// and, when the output can depend on the clock, a time bucket.
+struct PromptKey {
+  unsigned long epoch{0};
+  int status{0};
+  bool use_mod{false};
+  std::string tmpl;
+  long long tick{0};
+  bool operator==(const PromptKey& o) const {
+    return epoch==o.epoch && status==o.status && use_mod==o.use_mod && tick==o.tick && tmpl==o.tmpl;
   }
-  // 2) template
+};
+
+struct PromptCache {
+  bool valid{false};
+  PromptKey key;
+  std::string text;
+
+  // in-flight prompt mod render (runs on a detached worker thread, in a
+  // restricted runtime; g_prompt_stop stops it at its next statement)
+  std::future<std::pair<int,std::string>> pending;
+  PromptKey pending_key;
+};
+static PromptCache g_prompt;
+
+static long long now_ms(){
+  using namespace std::chrono;
+  return (long long)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static long long var_ms(Runtime& rt, const char* name, long long def){
+  const Value* v = rt.lookup(name);
+  if(!v) return def;
+  long long ms = (long long)std::atof(to_string(*v).c_str());
+  return ms > 0 ? ms : def;
+}
+
+static const char* const kDefaultPromptTmpl = "${status_emoji} ${shortcwd} pbsh> ";
+
+static std::string render_template(Runtime& rt, int last_status){
   auto it = rt.vars.find("PB_PROMPT_TMPL");
-  if(it!=rt.vars.end()){
-    return expand_template(to_string(it->second), last_status);
+  if(it!=rt.vars.end()) return expand_template(to_string(it->second), last_status);
+  return expand_template(kDefaultPromptTmpl, last_status);
+}
+
+// Stop the prompt mod render in flight and wait for it. Runs before repl()
+// returns and from atexit (Env.Exit), so the worker never outlives the
+// registry and stdout buffer it uses; restricted, it cannot block for long.
+static void prompt_stop(){
+  g_prompt_stop.store(true, std::memory_order_relaxed);
+  if(g_prompt.pending.valid()) g_prompt.pending.wait();
+}
+
+// Collect a finished prompt mod render, if any. Returns true if one was taken.
+static bool prompt_take_pending(Runtime& rt, int last_status){
+  auto& pc = g_prompt;
+  if(!pc.pending.valid()) return false;
+  if(pc.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+  auto [rc, out] = pc.pending.get();
+  pc.key = pc.pending_key;
+  pc.text = (rc==0 && !out.empty()) ? out : render_template(rt, last_status);
+  pc.valid = true;
+  return true;
+}
+
+static std::string build_prompt(Runtime& rt, int last_status, const std::unordered_set<std::string>& disabled){
+  auto& pc = g_prompt;
+
+  PromptKey key;
+  key.epoch   = prompt_epoch();
+  key.status  = last_status;
+  key.use_mod = !disabled.count("prompt") && mod_has("prompt");
+  if(auto it = rt.vars.find("PB_PROMPT_TMPL"); it != rt.vars.end()) key.tmpl = to_string(it->second);
+  if(key.use_mod){
+    // mods may show anything (git state, clock): refresh at most every PB_PROMPT_TTL_MS
+    key.tick = now_ms() / var_ms(rt, "PB_PROMPT_TTL_MS", 1000);
+  } else {
+    const std::string t = key.tmpl.empty() ? std::string(kDefaultPromptTmpl) : key.tmpl;
+    if(t.find("${time}") != std::string::npos) key.tick = now_ms() / 1000;  // HH:MM:SS
   }
-  // 3) default
-  return expand_template("${status_emoji} ${shortcwd} pbsh> ", last_status);
+
+  (void)prompt_take_pending(rt, last_status);
+  if(pc.valid && pc.key == key) return pc.text;
+
+  // 1) prompt mod, rendered within a time budget
+  if(key.use_mod){
+    auto deadline = std::chrono::steady_clock::now()
+                  + std::chrono::milliseconds(var_ms(rt, "PB_PROMPT_BUDGET_MS", 50));
+    // at most two rounds: finish a stale in-flight render, then start ours
+    for(int round = 0; round < 2; ++round){
+      if(!pc.pending.valid()){
+        // The REPL keeps mutating rt while the worker runs, so the mod reads a
+        // snapshot of the session variables: shared copy-on-write, so it
+        // costs nothing unless the REPL writes a variable mid-render.
+        auto snap = std::make_shared<Runtime>();
+        snap->vars = rt.vars;
+        snap->trap_sigint = false;
+        snap->restricted  = true;     // shares the process with the REPL
+        g_prompt_stop.store(false, std::memory_order_relaxed);
+        snap->cancel = &g_prompt_stop;
+        std::vector<std::string> args = {"--status", std::to_string(last_status)};
+        std::promise<std::pair<int,std::string>> done;
+        pc.pending_key = key;
+        pc.pending = done.get_future();   // unlike std::async's, never blocks in its destructor
+        static const bool stop_at_exit = (std::atexit(prompt_stop), true);   // before statics go
+        (void)stop_at_exit;
+        std::thread([snap, args, done = std::move(done)]() mutable {
+          std::string out;
+          int rc = mod_run_capture("prompt", args, *snap, &out);
+          done.set_value(std::make_pair(rc, std::move(out)));
+        }).detach();
+      }
+      if(pc.pending.wait_until(deadline) != std::future_status::ready) break;
+      (void)prompt_take_pending(rt, last_status);
+      if(pc.key == key) return pc.text;
+    }
+    // Over budget: show the previous prompt; the render lands on a later prompt.
+    if(pc.valid) return pc.text;
+    return render_template(rt, last_status);
+  }
+
+  // 2) template  3) default
+  pc.key   = key;
+  pc.text  = render_template(rt, last_status);
+  pc.valid = true;
+  return pc.text;
 }
 
+
 // ---- builtins: cd & pwd (affect parent process) ----
 static int builtin_cd(const std::vector<std::string>& argv){
   std::string target;
@@ -316,6 +329,7 @@ static int builtin_cd(const std::vector<std::string>& argv){
   }
   fs::current_path(newp, ec);
   if (ec) { std::cerr << "cd: " << ec.message() << "\n"; return 1; }
+  prompt_invalidate();
 
 #ifndef _WIN32
   setenv("OLDPWD", prev.c_str(), 1);
@@ -335,6 +349,32 @@ static int builtin_pwd(){
   return 0;
 }
 
+// ---- builtin: hash (command lookup table) ----
+static int builtin_hash(const std::vector<std::string>& argv){
+  if(argv.size() == 1){
+    auto hs = command_hash_list();
+    if(hs.empty()){ std::cout << "hash: hash table empty\n"; return 0; }
+    std::cout << "hits\tcommand\n";
+    for(const auto& h : hs) std::cout << std::setw(4) << h.hits << "\t" << h.path << "\n";
+    return 0;
+  }
+  if(argv[1] == "-r"){ command_hash_clear(); return 0; }
+
+  int rc = 0;
+  bool forget = (argv[1] == "-d"), show = (argv[1] == "-t");
+  for(size_t i = (forget || show) ? 2 : 1; i < argv.size(); ++i){
+    const std::string& name = argv[i];
+    if(forget){
+      if(!command_hash_forget(name)){ std::cerr << "hash: " << name << ": not found\n"; rc = 1; }
+      continue;
+    }
+    std::string path = command_hash_add(name);
+    if(path.empty()){ std::cerr << "hash: " << name << ": not found\n"; rc = 1; continue; }
+    if(show) std::cout << path << "\n";
+  }
+  return rc;
+}
+
 // mods meta helpers
 static void print_mods(Runtime& rt, const std::unordered_set<std::string>& disabled){
   auto names = list_mod_names_via_call(rt);
@@ -349,129 +389,403 @@ static void mods_help(){
   "  mods enable <name>   # enable a mod\n"
   "  mods disable <name>  # disable a mod\n"
   "  mods reload          # rescan mod directories\n"
+  "  mods plugins         # list native plugins and their namespaces\n"
+  "  mods stats [reset]   # per-mod call counts, timings and work done\n"
   "  mods run <name> [args...]  # run a mod\n";
 }
 
 // disabled mods set (session)
 static std::unordered_set<std::string> g_disabled_mods;
 
+// ---- input classification ----
+// Each REPL line is tokenized once and its first word looked up in one table:
+// meta commands and BASIC statement keywords (any case), builtins, then mods
+// and PATH programs. Only lines starting with a BASIC keyword reach the BASIC
+// parser. Unknown words still go to the launcher (which reports "command not
+// found" or hands shell syntax to sh).
+enum class WordKind { Meta, Builtin, Basic, Mod, External, Unknown };
+
+static const char* const kBuiltins[] = { "cd", "pwd", "hash", "jobs", "fg", "bg", "wait" };
+static const char* const kMetaWords[] = { "HELP", "BYE", "EXIT", "LIST", "RUN", "NEW", "SAVE", "LOAD", "MODS" };
+// Every statement the parser accepts starts with one of these
+static const char* const kBasicWords[] = {
+  "LET", "PRINT", "INPUT", "IF", "ELSEIF", "ELSE", "ENDIF", "END", "REM",
+  "GOTO", "GOSUB", "RETURN", "CALL", "WHILE", "WEND",
+};
+
+template <size_t N>
+static bool in_words(const char* const (&words)[N], const std::string& w){
+  for(const char* k : words) if(w == k) return true;
+  return false;
+}
+
+static bool is_builtin_word(const std::string& w){ return in_words(kBuiltins, w); }
+
+// Mod / External / Unknown, cached per word. The cache is dropped when mods
+// are added or removed, a mod is enabled or disabled, or PATH changes. A
+// stale External/Unknown entry is harmless: the launcher resolves the program
+// itself, the kind only decides whether a mod runs.
+static struct {
+  std::unordered_map<std::string, WordKind> kinds;
+  unsigned mod_gen{0};
+  std::string path;
+} g_words;
+
+static void word_cache_clear(){ g_words.kinds.clear(); }
+
+static WordKind command_word_kind(const std::string& w){
+  if(w.empty()) return WordKind::Unknown;
+  unsigned gen = mod_generation();
+  const char* path = std::getenv("PATH");
+  if(gen != g_words.mod_gen || g_words.path != (path ? path : "") || g_words.kinds.size() > 4096){
+    g_words.kinds.clear();
+    g_words.mod_gen = gen;
+    g_words.path = path ? path : "";
+  }
+  auto it = g_words.kinds.find(w);
+  if(it != g_words.kinds.end()) return it->second;
+
+  WordKind k = WordKind::Unknown;
+  if(!g_disabled_mods.count(w) && mod_has(w)) k = WordKind::Mod;
+  // fills the command hash, so the launcher's lookup is a hit
+  else if(!command_hash_add(w).empty()) k = WordKind::External;
+  g_words.kinds.emplace(w, k);
+  return k;
+}
+
+struct InputLine {
+  std::vector<std::string> argv;   // tokenize_quoted(line)
+  std::string word;                // argv[0], uppercased
+  WordKind kind{WordKind::Unknown};
+};
+
+static InputLine classify_line(const std::string& s){
+  InputLine in;
+  in.argv = tokenize_quoted(s);
+  // An apostrophe comment: the lexer reads the rest of the line as REM
+  if(!s.empty() && s[0]=='\''){ in.kind = WordKind::Basic; return in; }
+  if(in.argv.empty()) return in;
+  in.word = to_upper(in.argv[0]);
+  if(in_words(kMetaWords, in.word)) { in.kind = WordKind::Meta; return in; }
+  if(is_builtin_word(in.argv[0]))   { in.kind = WordKind::Builtin; return in; }
+
+  // The lexer's first identifier (letters, digits, '_' and '.')
+  size_t n = 0;
+  while(n < s.size() && (std::isalnum((unsigned char)s[n]) || s[n]=='_' || s[n]=='.')) ++n;
+  if(n && !std::isdigit((unsigned char)s[0]) && in_words(kBasicWords, to_upper(s.substr(0, n)))){
+    in.kind = WordKind::Basic;
+    return in;
+  }
+  in.kind = command_word_kind(in.argv[0]);
+  return in;
+}
+
+// "a | b | c" of mods, run in-process one after another: each stage's output
+// becomes the next one's input (TTY.ReadLine/INPUT).
+static int run_mod_pipeline(Runtime& rt, const std::vector<std::vector<std::string>>& cmds){
+  int status = 0;
+  std::istringstream feed;
+  for(size_t i=0;i<cmds.size();++i){
+    std::vector<std::string> a(cmds[i].begin()+1, cmds[i].end());
+    bool last = (i+1 == cmds.size());
+    StringSink buf;
+    status = mod_run_io(cmds[i][0], a, rt, last ? nullptr : &buf, i ? &feed : nullptr);
+    if(!last){ feed.clear(); feed.str(std::move(buf.buf)); }
+  }
+  return status;
+}
+
+// ---- input: paste and piped programs ----
+// Numbered lines (typed, pasted or piped in) are collected and stored in one
+// pass just before the next non-numbered line runs. Ascending runs, the usual
+// case, insert at an exact hint.
+using LineEdits = std::vector<std::pair<int, std::string>>;
+
+static void apply_edits(std::map<int, std::string>& program, LineEdits& edits){
+  auto hint = program.end();
+  for(auto& e : edits){
+    if(e.second.empty()){ program.erase(e.first); hint = program.end(); continue; }
+    hint = std::next(program.insert_or_assign(hint, e.first, std::move(e.second)));
+  }
+  edits.clear();
+}
+
+// "10 PRINT 1" -> {10, "PRINT 1"}; `s` is trimmed and starts with a digit
+static std::pair<int, std::string> split_numbered(const std::string& s){
+  size_t i = 0;
+  long n = 0;
+  for(; i < s.size() && std::isdigit((unsigned char)s[i]); ++i)
+    n = std::min<long>(n*10 + (s[i]-'0'), std::numeric_limits<int>::max());
+  return {(int)n, trim(s.substr(i))};
+}
+
+// A bracketed paste arrives as one string with embedded newlines
+static void queue_lines(const std::string& text, std::deque<std::string>& q){
+  size_t start = 0;
+  while(start <= text.size()){
+    size_t nl = text.find('\n', start);
+    if(nl == std::string::npos){ q.push_back(text.substr(start)); break; }
+    q.push_back(text.substr(start, nl - start));
+    start = nl + 1;
+  }
+}
+
+#ifndef USE_READLINE
+// Without readline the terminal's bracketed paste mode is switched on around
+// each read; the markers are stripped and the pasted block returned whole.
+static const char kPasteOn[]    = "\x1b[?2004h";
+static const char kPasteOff[]   = "\x1b[?2004l";
+static const char kPasteStart[] = "\x1b[200~";
+static const char kPasteEnd[]   = "\x1b[201~";
+
+static bool read_terminal_line(std::string& line){
+  if(!std::getline(std::cin, line)) return false;
+  size_t b = line.find(kPasteStart);
+  if(b == std::string::npos) return true;
+  line.erase(b, sizeof kPasteStart - 1);
+  std::string more;
+  while(line.find(kPasteEnd) == std::string::npos && std::getline(std::cin, more)) line += "\n" + more;
+  size_t e = line.find(kPasteEnd);
+  if(e != std::string::npos) line.erase(e, sizeof kPasteEnd - 1);
+  return true;
+}
+#endif
+
+#ifdef USE_READLINE
+// ---- tab completion: first word from builtins, meta commands, mods and the
+// PATH command index; later words fall back to readline's filename completion.
+static Runtime* g_complete_rt = nullptr;
+static std::vector<std::string> g_matches;
+
+static char* completion_generator(const char* /*text*/, int state){
+  static size_t next;
+  if(state == 0) next = 0;
+  if(next >= g_matches.size()) return nullptr;
+  return strdup(g_matches[next++].c_str());
+}
+
+static char** complete_command(const char* text, int start, int /*end*/){
+  for(int i=0;i<start;++i) if(!std::isspace((unsigned char)rl_line_buffer[i])) return nullptr;
+
+  std::string prefix = text;
+  std::set<std::string> found;
+  for(const char* b : kBuiltins) if(starts_with(b, prefix)) found.insert(b);
+  for(const char* m : {"mods", "LIST", "RUN", "NEW", "SAVE", "LOAD", "HELP", "BYE"})
+    if(starts_with(m, prefix)) found.insert(m);
+  if(g_complete_rt)
+    for(const auto& n : list_mod_names_via_call(*g_complete_rt))
+      if(!g_disabled_mods.count(n) && starts_with(n, prefix)) found.insert(n);
+  for(auto& c : path_commands(prefix)) found.insert(std::move(c));
+
+  g_matches.assign(found.begin(), found.end());
+  rl_attempted_completion_over = 1;   // no filename fallback for the command word
+  return rl_completion_matches(text, completion_generator);
+}
+#endif
+
 // ---------------- Interpreter ----------------
 void Interpreter::repl(const char* /*prompt_ignored*/){
   install_sig_handlers();
+  jobs_init();   // before any thread starts: SIGCHLD gets blocked
+  (void)stdout_sink();   // std::cout goes through the output buffer from here on
 #ifdef USE_READLINE
   rl_catch_signals = 0; // we handle SIGINT
+  g_complete_rt = &rt;
+  rl_attempted_completion_function = complete_command;
 #endif
 
   int last_status = 0;
-  std::cout << "PrismBASIC Shell — MVP (type HELP)\n";
+  // Piped stdin (`cat prog.bas | prismshell`): no banner or prompts, and
+  // numbered lines go straight into the pending edits.
+  const bool interactive = isatty(STDIN_FILENO);
+  if(interactive) std::cout << "PrismBASIC Shell — MVP (type HELP)\n";
+  // Otherwise script lines and INPUT share one fd reader (never freed, like
+  // the stdout buffer), whose read-ahead goes back to a seekable stdin
+  // before each command runs.
+  FdInBuf* script_in = nullptr;
+  if(!interactive){
+    script_in = new FdInBuf(STDIN_FILENO);
+    std::cin.rdbuf(script_in);
+  }
 
-  // Autoload mods on startup
+  // Autoload mods on startup, then watch the roots for edits
   autoload_mods(rt);
+  mod_watch_start();
+  plugins_autoload();
+
+  std::deque<std::string> queued;   // rest of a multi-line paste
+  LineEdits edits;                  // numbered lines not stored yet
 
   while(true){
     std::string line;
+    if(!queued.empty()){
+      line = std::move(queued.front());
+      queued.pop_front();
+    } else if(!interactive){
+      if(edits.empty()){
+        (void)mod_watch_poll();
+        jobs_notify();
+      }
+      if(!std::getline(std::cin, line)) break;
+    } else {
+      (void)mod_watch_poll();  // apply mod edits between commands
+      jobs_notify();           // "[1]+  Done ..." for background jobs
 #ifndef USE_READLINE
-    std::string ps = build_prompt(rt, last_status, g_disabled_mods);
-    std::cout << ps;
-    if(!std::getline(std::cin, line)){
-      if(take_interrupt()){ std::cout << "\n"; std::cin.clear(); std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); continue; }
-      break;
-    }
+      std::string ps = build_prompt(rt, last_status, g_disabled_mods);
+      std::cout << kPasteOn << ps << std::flush;
+      bool got = read_terminal_line(line);
+      std::cout << kPasteOff << std::flush;
+      if(!got){
+        if(take_interrupt()){ std::cout << "\n"; std::cin.clear(); std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); continue; }
+        break;
+      }
 #else
-    std::string ps = build_prompt(rt, last_status, g_disabled_mods);
-    char* in = readline(ps.c_str());
-    if(!in){
-      if(take_interrupt()){ std::cout << "\n"; continue; }
-      break;
-    }
-    line.assign(in);
-    if(!line.empty()) add_history(in);
-    free(in);
+      // readline's bracketed paste hands back the whole block at once
+      std::string ps = build_prompt(rt, last_status, g_disabled_mods);
+      stdout_flush();   // readline writes through C stdio
+      char* in = readline(ps.c_str());
+      if(!in){
+        if(take_interrupt()){ std::cout << "\n"; continue; }
+        break;
+      }
+      line.assign(in);
+      if(!line.empty()) add_history(in);
+      free(in);
 #endif
+      if(line.find('\n') != std::string::npos){
+        queue_lines(line, queued);
+        continue;
+      }
+    }
 
     std::string s = trim(line);
     if(s.empty()){ last_status = 0; continue; }
 
-    // Meta commands
-    std::string up = to_upper(s);
-    if(up=="HELP"){
-      std::cout << "Commands: LIST, RUN, NEW, SAVE <file>, LOAD <file>, BYE\n";
-      std::cout << "BASIC: line-numbered edits; PRINT/LET/INPUT/IF...THEN/GOTO/GOSUB/RETURN/CALL/END\n";
-      std::cout << "Builtins: cd, pwd\n";
-      std::cout << "MODS: type 'mods' for mod management\n";
+    // Retro line-numbered edit (bare number deletes)
+    if(is_integer_line(s)){
+      edits.push_back(split_numbered(s));
       last_status = 0; continue;
     }
-    if(up=="BYE" || up=="EXIT") break;
-    if(up=="LIST"){ rt.list(); last_status=0; continue; }
-    if(starts_with(up, "SAVE ")){ std::string p=trim(s.substr(5)); last_status = rt.save(p)?0:1; if(last_status) std::cout<<"Save failed\n"; continue; }
-    if(starts_with(up, "LOAD ")){ std::string p=trim(s.substr(5)); last_status = rt.load(p)?0:1; if(last_status) std::cout<<"Load failed\n"; continue; }
-    if(up=="NEW"){ rt.program.clear(); last_status=0; continue; }
-    if(up=="RUN"){ auto r=rt.run_program(); last_status = r.err?1:0; if(r.err) std::cout<<"Error at "<<r.err->line<<": "<<r.err->msg<<"\n"; continue; }
-
-    // mods meta
-    if(starts_with(up, "MODS")){
-      auto argv = tokenize_quoted(s);
-      std::string sub = (argv.size()>=2 ? to_upper(argv[1]) : "LIST");
-      if(sub=="LIST" || argv.size()==1){ print_mods(rt, g_disabled_mods); last_status=0; continue; }
-      if(sub=="HELP"){ mods_help(); last_status=0; continue; }
-      if(sub=="RELOAD"){
-        autoload_mods(rt);
-        std::cout<<"mods reloaded\n"; last_status=0; continue;
-      }
-      if(sub=="ENABLE" && argv.size()>=3){ g_disabled_mods.erase(argv[2]); std::cout<<"enabled "<<argv[2]<<"\n"; last_status=0; continue; }
-      if(sub=="DISABLE" && argv.size()>=3){ g_disabled_mods.insert(argv[2]); std::cout<<"disabled "<<argv[2]<<"\n"; last_status=0; continue; }
-      if(sub=="RUN" && argv.size()>=3){
-        std::string name = argv[2]; std::vector<std::string> a; for(size_t i=3;i<argv.size();++i) a.push_back(argv[i]);
-        if(g_disabled_mods.count(name)){ std::cout<<"mod '"<<name<<"' is disabled\n"; last_status=1; continue; }
-        if(!mod_has(name)){ std::cout<<"no such mod: "<<name<<"\n"; last_status=127; continue; }
-        last_status = mod_run(name, a, rt); continue;
+    apply_edits(rt.program, edits);
+    (void)mod_watch_poll();  // edits made while the line was being typed
+    if(script_in) script_in->release();   // a seekable script: commands read on from here
+
+    InputLine input = classify_line(s);
+    const auto& argv = input.argv;
+
+    // Meta commands (forms they don't accept fall through as commands)
+    if(input.kind == WordKind::Meta){
+      const std::string& w = input.word;
+      bool bare = argv.size() == 1;
+      if(w=="HELP" && bare){
+        std::cout << "Commands: LIST, RUN, NEW, SAVE <file>, LOAD <file>, BYE\n";
+        std::cout << "BASIC: line-numbered edits; PRINT/LET/INPUT/IF...THEN/GOTO/GOSUB/RETURN/CALL/END\n";
+        std::cout << "Builtins: cd, pwd, hash, jobs, fg, bg, wait (cmd & runs in the background)\n";
+        std::cout << "MODS: type 'mods' for mod management\n";
+        last_status = 0; continue;
       }
-      std::cout<<"unknown mods command; try 'mods help'\n"; last_status=2; continue;
-    }
-
-    // Builtins: cd/pwd (before BASIC/mod/shell)
-    {
-      auto argv = tokenize_quoted(s);
-      if(!argv.empty()){
-        if(argv[0] == "cd"){
-          last_status = builtin_cd(argv);
-          continue;
+      if((w=="BYE" || w=="EXIT") && bare) break;
+      if(w=="LIST" && bare){ rt.list(); last_status=0; continue; }
+      if(w=="SAVE" && !bare){ std::string p=trim(s.substr(4)); last_status = rt.save(p)?0:1; if(last_status) std::cout<<"Save failed\n"; continue; }
+      if(w=="LOAD" && !bare){ std::string p=trim(s.substr(4)); last_status = rt.load(p)?0:1; if(last_status) std::cout<<"Load failed\n"; continue; }
+      if(w=="NEW" && bare){ rt.program.clear(); last_status=0; continue; }
+      if(w=="RUN" && bare){ auto r=rt.run_program(); prompt_invalidate(); last_status = r.err?1:0; if(r.err) std::cout<<"Error at "<<r.err->line<<": "<<r.err->msg<<"\n"; continue; }
+
+      if(w=="MODS"){
+        std::string sub = (argv.size()>=2 ? to_upper(argv[1]) : "LIST");
+        if(sub=="LIST" || argv.size()==1){ print_mods(rt, g_disabled_mods); last_status=0; continue; }
+        if(sub=="HELP"){ mods_help(); last_status=0; continue; }
+        if(sub=="PLUGINS"){
+          auto ps = plugin_list();
+          if(ps.empty()) std::cout << "(no plugins loaded)\n";
+          for(const auto& p : ps) std::cout << p << "\n";
+          last_status=0; continue;
+        }
+        if(sub=="STATS"){
+          if(argv.size()>=3 && to_upper(argv[2])=="RESET"){ mod_stats_reset(); std::cout<<"mod stats reset\n"; last_status=0; continue; }
+          std::string t = mod_stats_table(false);
+          if(t.find('\n') + 1 == t.size()) std::cout << "(no mods have run)\n";
+          else std::cout << t;
+          last_status=0; continue;
+        }
+        if(sub=="RELOAD"){
+          autoload_mods(rt);
+          mod_watch_start();
+          plugins_autoload();  // picks up new .so files; loaded ones stay
+          std::cout<<"mods reloaded\n"; last_status=0; continue;
         }
-        if(argv[0] == "pwd"){
-          last_status = builtin_pwd();
-          continue;
+        if(sub=="ENABLE" && argv.size()>=3){ g_disabled_mods.erase(argv[2]); word_cache_clear(); std::cout<<"enabled "<<argv[2]<<"\n"; last_status=0; continue; }
+        if(sub=="DISABLE" && argv.size()>=3){ g_disabled_mods.insert(argv[2]); word_cache_clear(); std::cout<<"disabled "<<argv[2]<<"\n"; last_status=0; continue; }
+        if(sub=="RUN" && argv.size()>=3){
+          std::string name = argv[2]; std::vector<std::string> a; for(size_t i=3;i<argv.size();++i) a.push_back(argv[i]);
+          if(g_disabled_mods.count(name)){ std::cout<<"mod '"<<name<<"' is disabled\n"; last_status=1; continue; }
+          if(!mod_has(name)){ std::cout<<"no such mod: "<<name<<"\n"; last_status=127; continue; }
+          last_status = mod_run(name, a, rt); continue;
         }
+        std::cout<<"unknown mods command; try 'mods help'\n"; last_status=2; continue;
       }
+      input.kind = command_word_kind(argv[0]);
     }
 
-    // Retro line-numbered edit
-    if(is_integer_line(s)){
-      std::istringstream iss(s); int n=0; iss>>n; std::string rest; std::getline(iss,rest); rest=trim(rest);
-      if(rest.empty()) rt.program.erase(n); else rt.program[n]=rest;
-      last_status = 0; continue;
+    // Builtins: cd/pwd/hash and job control
+    if(input.kind == WordKind::Builtin){
+      if(argv[0] == "cd")       last_status = builtin_cd(argv);
+      else if(argv[0] == "pwd") last_status = builtin_pwd();
+      else if(argv[0] == "hash") last_status = builtin_hash(argv);
+      else last_status = job_command(argv);
+      continue;
     }
 
-    // Try BASIC direct
-    if(auto r = rt.run_line_direct(s, 0); !r.err){ last_status = 0; continue; }
-
-    // Try mod dispatch first (quoted args aware)
-    {
-      auto argv = tokenize_quoted(s);
-      if(!argv.empty()){
-        std::string cmd = argv[0]; std::vector<std::string> a; for(size_t i=1;i<argv.size();++i) a.push_back(argv[i]);
-        if(!cmd.empty() && !g_disabled_mods.count(cmd) && mod_has(cmd)){
-          last_status = mod_run(cmd, a, rt);
-          continue;
+    // BASIC direct mode; a line that doesn't parse or run is tried as a command
+    if(input.kind == WordKind::Basic){
+      if(auto r = rt.run_line_direct(s, 0); !r.err){ prompt_invalidate(); last_status = 0; continue; }
+      input.kind = command_word_kind(argv[0]);
+    }
+
+    // Command line. Parsed once here; the launcher reuses the stages.
+    bool background = split_background(s, nullptr);
+    std::vector<Stage> native;
+    bool parsed = !background && parse_pipeline(s, native);
+
+    std::vector<std::vector<std::string>> mods;   // set when every stage is a mod
+    if(parsed){
+      bool redirected = std::any_of(native.begin(), native.end(), [](const Stage& st){ return !st.redirs.empty(); });
+      bool all_mods = !redirected;
+      for(size_t i=0; all_mods && i<native.size(); ++i)
+        all_mods = (i ? command_word_kind(native[i].argv[0]) : input.kind) == WordKind::Mod;
+      if(all_mods) for(const auto& st : native) mods.push_back(st.argv);
+    } else if(!background){
+      // Shell syntax: mods still get first pick, their words taken literally
+      std::vector<std::string> stages;
+      if(split_pipeline(s, stages)){
+        for(const auto& st : stages){
+          mods.push_back(tokenize_quoted(st));
+          if(mods.back().empty() || command_word_kind(mods.back()[0]) != WordKind::Mod){ mods.clear(); break; }
         }
+      } else if(input.kind == WordKind::Mod){
+        mods.push_back(argv);
       }
     }
+    if(mods.size() == 1){
+      std::vector<std::string> a(mods[0].begin()+1, mods[0].end());
+      last_status = mod_run(mods[0][0], a, rt);
+      continue;
+    }
+    if(!mods.empty()){ last_status = run_mod_pipeline(rt, mods); continue; }
 
-    // Fallback: /bin/sh -lc  (parent ignores SIGINT so Ctrl-C kills only child)
+    // The launcher (mixed pipelines, programs, sh). With a terminal the job
+    // gets its own process group and the terminal; without one, ignoring
+    // SIGINT here lets Ctrl-C kill only the child.
     auto prev = std::signal(SIGINT, SIG_IGN);
-    last_status = rt.sh_exec(s);
+    last_status = rt.sh_exec(s, [](const std::string& cmd){ return command_word_kind(cmd) == WordKind::Mod; },
+                             parsed ? &native : nullptr);
     std::signal(SIGINT, prev);
     (void)take_interrupt(); // drain pending SIGINT so next prompt isn't interrupted
   }
+  apply_edits(rt.program, edits);
+  prompt_stop();
+  jobs_shutdown();
+  stdout_flush();
 }
 
   /// Run a file/script
@@ -491,7 +805,9 @@ void Interpreter::repl(const char* /*prompt_ignored*/){
     }
 
     // Pass argv to program
-    rt.vars["PB_ARGV"] = json_array(args);
+    rt.vars["PB_ARGV"] = join_list(args);
+    (void)stdout_sink();
+    plugins_autoload();  // native CALL providers
 
     // Helper: detect BASIC comment line after trimming
     auto is_comment_line = [](const std::string& t)->bool{
@@ -559,6 +875,7 @@ void Interpreter::repl(const char* /*prompt_ignored*/){
     }
 
     auto r = rt.run_program();
+    stdout_flush();
     if(r.err){
       std::cerr << "Error at " << r.err->line << ": " << r.err->msg << "\n";
       return 2;
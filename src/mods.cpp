@@ -0,0 +1,454 @@
+#include "prismshell/mods.hpp"
+#include "prismshell/runtime.hpp"
+#include "prismshell/utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <unordered_map>
+
+#ifdef __linux__
+  #include <sys/inotify.h>
+  #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace pb {
+
+// ---- discovery --------------------------------------------------------------
+static bool has_ext_ci(const fs::path& p, const std::vector<std::string>& exts){
+  auto e = p.extension().string();
+  std::string up; up.reserve(e.size());
+  for(char c: e) up.push_back((char)std::toupper((unsigned char)c));
+  for(const auto& want : exts){
+    if(up == want) return true;
+  }
+  return false;
+}
+
+std::vector<fs::path> mod_search_paths(){
+  std::vector<fs::path> roots;
+  // project-local (current dir)
+  roots.emplace_back(fs::path("mods"));
+  // user
+  if(const char* home = std::getenv("HOME")){
+    roots.emplace_back(fs::path(home) / ".config/prismshell/mods");
+  }
+  // system
+  roots.emplace_back(fs::path("/usr/local/share/prismshell/mods"));
+  roots.emplace_back(fs::path("/usr/share/prismshell/mods"));
+  // env PRISMSHELL_MOD_PATH (colon-separated)
+  if(const char* extra = std::getenv("PRISMSHELL_MOD_PATH")){
+    std::string s = extra;
+    size_t start=0;
+    while(true){
+      size_t sep = s.find(':', start);
+      std::string chunk = (sep==std::string::npos) ? s.substr(start) : s.substr(start, sep-start);
+      if(!chunk.empty()) roots.emplace_back(chunk);
+      if(sep==std::string::npos) break;
+      start = sep+1;
+    }
+  }
+  for(auto& r : roots){
+    std::error_code ec;
+    fs::path abs = fs::absolute(r, ec);
+    if(!ec) r = abs.lexically_normal();
+  }
+  return roots;
+}
+
+// ---- loading ----------------------------------------------------------------
+bool read_mod_program(const fs::path& p, std::map<int,std::string>& out){
+  std::ifstream f(p);
+  if(!f) return false;
+  std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  // strip shebang if present
+  if(!content.empty() && content.rfind("#!", 0) == 0){
+    auto nl = content.find('\n');
+    content = (nl == std::string::npos) ? std::string() : content.substr(nl+1);
+  }
+  // numbered?
+  bool numbered = true;
+  {
+    std::istringstream iss(content); std::string line;
+    while(std::getline(iss, line)){
+      std::string t = trim(line); if(t.empty()) continue;
+      if(!std::isdigit((unsigned char)t[0])){ numbered=false; break; }
+    }
+  }
+  if(numbered){
+    std::istringstream iss2(content); std::string line;
+    while(std::getline(iss2, line)){
+      std::string t = trim(line); if(t.empty()) continue;
+      auto sp = t.find(' '); if(sp == std::string::npos) continue;
+      int n = std::stoi(t.substr(0, sp));
+      std::string src = trim(t.substr(sp+1));
+      out[n] = src;
+    }
+  } else {
+    std::istringstream iss2(content); std::string line; int n=10;
+    while(std::getline(iss2, line)){
+      std::string t = trim(line); if(t.empty()) continue;
+      out[n] = t; n += 10;
+    }
+  }
+  return true;
+}
+
+// Result of loading one mod file: read and compiled on a worker thread, its
+// registration code run on the calling thread, applied later.
+struct ModLoad {
+  fs::path path;
+  std::shared_ptr<const std::map<int,std::string>> program;   // null: unreadable
+  std::shared_ptr<const ProgramImage> image;
+  std::vector<ModRegistration> regs;
+  std::string err;
+  long long mtime{0};
+  unsigned long long size{0};
+  bool from_manifest{false};   // registered as a stub, program not loaded
+  bool ok{false};
+};
+
+// Worker-thread half: read and parse the file. Touches nothing shared.
+static void read_mod_file(ModLoad& out){
+  auto prog = std::make_shared<std::map<int,std::string>>();
+  if(!read_mod_program(out.path, *prog)) return;
+  out.image   = ProgramImage::compile(*prog);
+  out.program = std::move(prog);
+}
+
+// Calling-thread half: run the registration code. Loads are run in load
+// order, so whatever else that code does (Env.Set, FS.Write, Shell.Run)
+// happens in the same order as it would one file at a time.
+static void run_mod_file(ModLoad& out){
+  const fs::path& p = out.path;
+  if(!out.program) return;
+  Runtime mrt; // child runtime to execute registration code
+  mrt.mod_sink = &out.regs;    // registrations are applied in order by the caller
+  mrt.shared_program = out.program;
+  mrt.image = out.image;
+  mrt.vars["PB_ARGV"] = std::string("[]");
+  auto r = mrt.run_program();
+  if(r.err){
+    std::ostringstream os;
+    os << "Mod load error in " << p << " at " << r.err->line << ": " << r.err->msg << "\n";
+    out.err = os.str();
+    return;
+  }
+  for(auto& reg : out.regs) reg.source = p.string();
+  out.ok = true;
+}
+
+// ---- manifest ---------------------------------------------------------------
+// One file per mod root, e.g. ~/.cache/prismshell/manifests/%home%me%mods.manifest
+//
+//   # prismshell mod manifest v1
+//   F <tab> file name <tab> mtime <tab> size
+//   R <tab> command <tab> entry line        (registrations of the preceding F)
+struct ManifestFile {
+  long long mtime{0};
+  unsigned long long size{0};
+  std::vector<std::pair<std::string,int>> regs;
+};
+using Manifest = std::unordered_map<std::string, ManifestFile>;
+
+static const char* const kManifestHeader = "# prismshell mod manifest v1";
+
+fs::path mod_manifest_path(const fs::path& root){
+  fs::path base;
+  if(const char* x = std::getenv("XDG_CACHE_HOME"); x && *x) base = x;
+  else if(const char* home = std::getenv("HOME")) base = fs::path(home) / ".cache";
+  else return {};
+  std::error_code ec;
+  std::string key = fs::absolute(root, ec).lexically_normal().string();
+  for(char& c : key) if(c=='/' || c=='\\' || c==':') c = '%';
+  return base / "prismshell" / "manifests" / (key + ".manifest");
+}
+
+static Manifest read_manifest(const fs::path& mpath){
+  Manifest m;
+  std::ifstream f(mpath);
+  std::string line;
+  if(!f || !std::getline(f, line) || line != kManifestHeader) return m;
+  ManifestFile* cur = nullptr;
+  while(std::getline(f, line)){
+    std::vector<std::string> cols; size_t a = 0;
+    while(true){
+      size_t t = line.find('\t', a);
+      cols.push_back(line.substr(a, t==std::string::npos ? std::string::npos : t-a));
+      if(t==std::string::npos) break;
+      a = t+1;
+    }
+    try {
+      if(cols.size()==4 && cols[0]=="F"){
+        ManifestFile mf; mf.mtime = std::stoll(cols[2]); mf.size = std::stoull(cols[3]);
+        cur = &(m[cols[1]] = std::move(mf));
+      } else if(cols.size()==3 && cols[0]=="R" && cur){
+        cur->regs.emplace_back(cols[1], std::stoi(cols[2]));
+      }
+    } catch(...) { return Manifest{}; }  // corrupt: rebuild from scratch
+  }
+  return m;
+}
+
+static void write_manifest(const fs::path& mpath, const Manifest& m){
+  if(mpath.empty()) return;
+  std::error_code ec;
+  fs::create_directories(mpath.parent_path(), ec);
+  fs::path tmp = mpath; tmp += ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::trunc);
+    if(!f) return;
+    std::vector<const std::pair<const std::string, ManifestFile>*> rows;
+    for(const auto& kv : m) rows.push_back(&kv);
+    std::sort(rows.begin(), rows.end(), [](auto* a, auto* b){ return a->first < b->first; });
+    f << kManifestHeader << "\n";
+    for(auto* kv : rows){
+      f << "F\t" << kv->first << "\t" << kv->second.mtime << "\t" << kv->second.size << "\n";
+      for(const auto& r : kv->second.regs) f << "R\t" << r.first << "\t" << r.second << "\n";
+    }
+    if(!f) return;
+  }
+  fs::rename(tmp, mpath, ec);  // atomic replace
+}
+
+static bool manifest_safe(const std::string& s){
+  return s.find_first_of("\t\n\r") == std::string::npos;
+}
+
+// ---- autoload ---------------------------------------------------------------
+struct RootScan {
+  fs::path root;
+  fs::path manifest;
+  Manifest known;
+  Manifest next;
+  size_t first{0}, count{0};   // slice of the global load list
+};
+
+// In-memory view of what autoload found, used for incremental reloads.
+struct ModFile {
+  size_t root{0};                      // index into g_roots (search order)
+  std::vector<ModRegistration> regs;
+};
+static std::vector<RootScan> g_roots;
+static std::map<std::string, ModFile> g_files;  // key: absolute file path
+
+void autoload_mods(Runtime& rt){
+  // Try to clear registry if supported
+  (void)rt.run_line_direct("CALL Mod.Clear()", 0); // ignore errors if not implemented
+
+  // 1) collect files: roots in search order, names sorted within a root.
+  //    Files whose mtime/size match the manifest become stubs.
+  std::vector<std::string> exts = { ".BAS", ".PBAS" };
+  std::vector<ModLoad> loads;
+  std::vector<RootScan> roots;
+  for(const auto& root : mod_search_paths()){
+    std::error_code ec;
+    if(!fs::exists(root, ec) || !fs::is_directory(root, ec)) continue;
+    RootScan rs;
+    rs.root = root;
+    rs.manifest = mod_manifest_path(root);
+    if(!rs.manifest.empty()) rs.known = read_manifest(rs.manifest);
+    rs.first = loads.size();
+
+    std::vector<fs::path> files;
+    for(auto it = fs::directory_iterator(root, ec); !ec && it!=fs::end(it); it.increment(ec)){
+      if(!it->is_regular_file()) continue;
+      const auto& p = it->path();
+      if(has_ext_ci(p, exts)) files.push_back(p);
+    }
+    std::sort(files.begin(), files.end());
+    for(auto& p : files){
+      ModLoad l; l.path = std::move(p);
+      std::string fname = l.path.filename().string();
+      // stat before loading, so an edit racing the load is picked up next time
+      l.mtime = (long long)fs::last_write_time(l.path, ec).time_since_epoch().count();
+      if(!ec) l.size = fs::file_size(l.path, ec);
+      auto k = rs.known.find(fname);
+      if(!ec && k != rs.known.end() && k->second.mtime == l.mtime && k->second.size == l.size){
+        for(const auto& r : k->second.regs)
+          l.regs.push_back(ModRegistration{r.first, r.second, nullptr, l.path.string()});
+        l.from_manifest = l.ok = true;
+        rs.next[fname] = k->second;
+      }
+      loads.push_back(std::move(l));
+    }
+    rs.count = loads.size() - rs.first;
+    roots.push_back(std::move(rs));
+  }
+
+  // 2) read and parse new/changed files concurrently, then run their
+  //    registration code here, in load order
+  std::vector<size_t> todo;
+  for(size_t i=0;i<loads.size();++i) if(!loads[i].from_manifest) todo.push_back(i);
+  parallel_for(todo.size(), [&](size_t k){ read_mod_file(loads[todo[k]]); });
+  for(size_t i : todo) run_mod_file(loads[i]);
+
+  // 3) refresh manifests of roots with new, modified, failed or removed files.
+  //    Failed loads stay out of the manifest so they are retried next start.
+  for(auto& rs : roots){
+    bool dirty = rs.next.size() != rs.known.size();
+    for(size_t i=rs.first; i<rs.first+rs.count; ++i){
+      const ModLoad& l = loads[i];
+      if(l.from_manifest) continue;
+      dirty = true;
+      std::string fname = l.path.filename().string();
+      if(!l.ok || !manifest_safe(fname)) continue;
+      ManifestFile mf; mf.mtime = l.mtime; mf.size = l.size;
+      bool safe = true;
+      for(const auto& r : l.regs){ safe &= manifest_safe(r.name); mf.regs.emplace_back(r.name, r.entry); }
+      if(safe) rs.next[fname] = std::move(mf);
+    }
+    if(dirty) write_manifest(rs.manifest, rs.next);
+  }
+
+  // 4) remember the layout for incremental reloads (mod_watch_poll); paths
+  //    are absolute so they still match inotify events after a `cd`
+  g_files.clear();
+  for(size_t r=0; r<roots.size(); ++r)
+    for(size_t i=roots[r].first; i<roots[r].first+roots[r].count; ++i){
+      std::error_code ec;
+      if(loads[i].ok) g_files[fs::absolute(loads[i].path, ec).string()] = ModFile{r, loads[i].regs};
+    }
+
+  // 5) apply in deterministic order; later roots override earlier ones
+  std::vector<ModRegistration> regs;
+  for(auto& l : loads){
+    if(!l.err.empty()) std::cerr << l.err;
+    for(auto& r : l.regs) regs.push_back(std::move(r));
+  }
+  mod_apply(regs);
+  g_roots = std::move(roots);
+}
+
+// ---- hot reload ---------------------------------------------------------------
+// inotify on every root; changed files are reloaded one by one and applied to
+// the registry in one step. A file that fails to load keeps its previous version.
+#ifdef __linux__
+static int g_watch_fd = -1;
+static std::unordered_map<int, size_t> g_watch_root;  // watch descriptor -> root index
+static std::vector<fs::path> g_watch_dirs;             // root index -> absolute directory
+
+void mod_watch_start(){
+  if(g_watch_fd >= 0){ ::close(g_watch_fd); g_watch_fd = -1; }
+  g_watch_root.clear();
+  g_watch_dirs.clear();
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(fd < 0) return;
+  const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+  for(size_t r=0; r<g_roots.size(); ++r){
+    // resolved now: event paths must not follow the shell's later `cd`s
+    std::error_code ec;
+    g_watch_dirs.push_back(fs::absolute(g_roots[r].root, ec));
+    int wd = inotify_add_watch(fd, g_watch_dirs.back().c_str(), mask);
+    if(wd >= 0) g_watch_root[wd] = r;
+  }
+  g_watch_fd = fd;
+}
+
+// Drain pending events into (root, path) pairs. Overflow rescans every root.
+static std::map<std::string, size_t> watch_drain(){
+  std::map<std::string, size_t> changed;
+  alignas(struct inotify_event) char buf[8192];
+  bool overflow = false;
+  while(true){
+    ssize_t n = ::read(g_watch_fd, buf, sizeof(buf));
+    if(n <= 0) break;
+    for(char* p = buf; p < buf + n; ){
+      auto* ev = reinterpret_cast<struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + ev->len;
+      if(ev->mask & IN_Q_OVERFLOW){ overflow = true; continue; }
+      auto it = g_watch_root.find(ev->wd);
+      if(it == g_watch_root.end() || ev->len == 0) continue;
+      changed[(g_watch_dirs[it->second] / ev->name).string()] = it->second;
+    }
+  }
+  if(overflow){
+    for(const auto& kv : g_files) changed[kv.first] = kv.second.root;
+    for(size_t r=0; r<g_roots.size(); ++r){
+      std::error_code ec;
+      for(auto it = fs::directory_iterator(g_watch_dirs[r], ec); !ec && it!=fs::end(it); it.increment(ec))
+        changed[it->path().string()] = r;
+    }
+  }
+  return changed;
+}
+
+bool mod_watch_poll(){
+  if(g_watch_fd < 0) return false;
+  auto changed = watch_drain();
+  if(changed.empty()) return false;
+
+  // 1) reload files that still exist; the rest are deletions
+  std::vector<std::string> exts = { ".BAS", ".PBAS" };
+  std::vector<ModLoad> loads;
+  std::vector<std::pair<std::string,size_t>> gone;
+  for(const auto& [path, root] : changed){
+    fs::path p(path);
+    std::error_code ec;
+    if(!has_ext_ci(p, exts)) continue;
+    if(!fs::is_regular_file(p, ec)){ if(g_files.count(path)) gone.emplace_back(path, root); continue; }
+    ModLoad l; l.path = p;
+    l.mtime = (long long)fs::last_write_time(p, ec).time_since_epoch().count();
+    if(!ec) l.size = fs::file_size(p, ec);
+    loads.push_back(std::move(l));
+  }
+  parallel_for(loads.size(), [&](size_t i){ read_mod_file(loads[i]); });
+  for(auto& l : loads) run_mod_file(l);
+
+  // 2) update the index and manifests; remember which command names moved
+  std::vector<std::string> touched;
+  std::vector<bool> dirty(g_roots.size(), false);
+  auto note = [&](const std::vector<ModRegistration>& regs){ for(const auto& r : regs) touched.push_back(r.name); };
+  for(auto& l : loads){
+    if(!l.ok){ std::cerr << l.err; continue; }  // keep the previous good version
+    std::string path = l.path.string();
+    size_t root = changed[path];
+    if(auto it = g_files.find(path); it != g_files.end()) note(it->second.regs);
+    note(l.regs);
+    std::string fname = l.path.filename().string();
+    ManifestFile mf; mf.mtime = l.mtime; mf.size = l.size;
+    bool safe = manifest_safe(fname);
+    for(const auto& r : l.regs){ safe &= manifest_safe(r.name); mf.regs.emplace_back(r.name, r.entry); }
+    if(safe) g_roots[root].next[fname] = std::move(mf);
+    else     g_roots[root].next.erase(fname);
+    dirty[root] = true;
+    g_files[path] = ModFile{root, std::move(l.regs)};
+  }
+  for(const auto& [path, root] : gone){
+    note(g_files[path].regs);
+    g_files.erase(path);
+    g_roots[root].next.erase(fs::path(path).filename().string());
+    dirty[root] = true;
+  }
+
+  // 3) recompute the winner of every touched name: last provider in
+  //    (root, file) order, same as a full autoload would pick
+  std::sort(touched.begin(), touched.end());
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+  std::vector<ModRegistration> set;
+  std::vector<std::string> drop;
+  for(const auto& name : touched){
+    const ModRegistration* best = nullptr; size_t best_root = 0;
+    for(const auto& [path, mf] : g_files)    // ordered by path within a root
+      for(const auto& r : mf.regs)
+        if(r.name == name && (!best || mf.root >= best_root)){ best = &r; best_root = mf.root; }
+    if(best) set.push_back(*best); else drop.push_back(name);
+  }
+  mod_apply(set, drop);
+
+  for(size_t r=0; r<g_roots.size(); ++r)
+    if(dirty[r]) write_manifest(g_roots[r].manifest, g_roots[r].next);
+  return !set.empty() || !drop.empty();
+}
+#else
+void mod_watch_start(){}
+bool mod_watch_poll(){ return false; }
+#endif
+
+} // namespace pb
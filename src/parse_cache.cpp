@@ -0,0 +1,61 @@
+#include "prismshell/parse_cache.hpp"
+#include "prismshell/lexer.hpp"
+
+namespace pb {
+
+static std::string cache_key(const std::string& src, int line){
+  // line numbers are baked into tokens/stmts, so they are part of the key
+  std::string k = std::to_string(line);
+  k.push_back('\x1f');
+  k += src;
+  return k;
+}
+
+ParsedLine ParseCache::get(const std::string& src, int line){
+  std::string key = cache_key(src, line);
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    auto it = index.find(key);
+    if(it != index.end()){
+      lru.splice(lru.begin(), lru, it->second);
+      return it->second->val;
+    }
+  }
+
+  // Miss: parse outside the lock (a racing duplicate parse is harmless)
+  Lexer lx(src, line);
+  Parser p(lx.lex());
+  auto parsed = std::make_shared<const ParseOut>(p.parse());
+
+  std::lock_guard<std::mutex> lk(mu);
+  auto it = index.find(key);
+  if(it != index.end()){
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->val;
+  }
+  lru.push_front(Node{key, parsed});
+  index.emplace(std::move(key), lru.begin());
+  while(lru.size() > cap){
+    index.erase(lru.back().key);
+    lru.pop_back();
+  }
+  return parsed;
+}
+
+void ParseCache::clear(){
+  std::lock_guard<std::mutex> lk(mu);
+  index.clear();
+  lru.clear();
+}
+
+size_t ParseCache::size() const {
+  std::lock_guard<std::mutex> lk(mu);
+  return lru.size();
+}
+
+ParseCache& direct_parse_cache(){
+  static ParseCache cache;
+  return cache;
+}
+
+} // namespace pb
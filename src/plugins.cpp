@@ -0,0 +1,229 @@
+#include "prismshell/plugins.hpp"
+#include "prismshell/utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#ifndef _WIN32
+  #include <dlfcn.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Opaque ABI types (declared in plugin.h at global scope)
+struct pb_result { pb::Value v; };
+struct pb_registrar {
+  std::string path;
+  std::vector<std::string> namespaces;
+};
+
+namespace pb {
+
+/* ---------------- registry ---------------- */
+
+static std::mutex g_plugins_mu;
+static std::unordered_map<std::string, std::unique_ptr<PluginFn>> g_plugin_fns; // "NS.FN" -> fn
+static std::vector<std::unique_ptr<PluginFn>> g_plugin_retired;                // replaced, maybe still in a call
+static std::set<std::string> g_plugin_paths;                                   // loaded files
+static std::vector<std::string> g_plugin_info;                                 // for plugin_list()
+static std::atomic<unsigned> g_plugin_gen{1};  // bumped when the table changes
+
+static std::string upper(std::string s){ for(char& c: s) c=(char)std::toupper((unsigned char)c); return s; }
+
+// Namespaces handled by call_dispatch; plugins may not shadow them.
+static bool reserved_ns(const std::string& ns_up){
+  static const char* const kReserved[] = {
+    "ENV", "TTY", "FS", "MOD", "PROMPT", "RNG", "UI", "TIME", "SHELL", "MOUNT", "LIST",
+  };
+  for(const char* r : kReserved) if(ns_up == r) return true;
+  return false;
+}
+
+/* ---------------- host API ---------------- */
+
+static void host_set_num(pb_result* out, double v){ if(out) out->v = Value{v}; }
+static void host_set_str(pb_result* out, const char* s, size_t len){
+  if(out) out->v = Value{std::string(s ? s : "", s ? len : 0)};
+}
+
+static bool valid_params(const char* p){
+  if(!p) return true;
+  for(const char* c = p; *c; ++c){
+    if(*c=='*' && c[1]=='\0' && c != p) continue;
+    if(*c!='s' && *c!='n' && *c!='v') return false;
+  }
+  return true;
+}
+
+static int host_register_namespace(pb_registrar* reg, const char* ns, const pb_function* fns, size_t n){
+  if(!reg || !ns || !*ns || (!fns && n)) return 1;
+  std::string ns_up = upper(ns);
+  if(reserved_ns(ns_up) || ns_up.find('.') != std::string::npos) return 1;
+  for(size_t i=0;i<n;++i) if(!fns[i].name || !fns[i].fn || !valid_params(fns[i].params)) return 1;
+
+  std::lock_guard<std::mutex> lk(g_plugins_mu);
+  for(size_t i=0;i<n;++i){
+    auto f = std::make_unique<PluginFn>();
+    f->qname    = ns_up + "." + upper(fns[i].name);
+    f->params   = fns[i].params ? fns[i].params : "";
+    f->fn       = fns[i].fn;
+    f->userdata = fns[i].userdata;
+    // A replaced function may be running on another thread (prompt render,
+    // mod stages): keep it alive; bound call sites rebind on the gen bump.
+    auto& slot = g_plugin_fns[f->qname];
+    if(slot) g_plugin_retired.push_back(std::move(slot));
+    slot = std::move(f);
+  }
+  reg->namespaces.push_back(ns);
+  g_plugin_gen.fetch_add(1, std::memory_order_release);
+  return 0;
+}
+
+static const pb_host_api g_host_api = {
+  PB_PLUGIN_ABI_VERSION, host_set_num, host_set_str, host_register_namespace,
+};
+
+/* ---------------- binding & calls ---------------- */
+
+const PluginFn* plugin_bind(CallBinding& b, const std::string& qname){
+  unsigned gen = g_plugin_gen.load(std::memory_order_acquire);
+  if(b.gen.load(std::memory_order_acquire) == gen) return b.fn.load(std::memory_order_relaxed);
+
+  const PluginFn* f = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(g_plugins_mu);
+    if(!g_plugin_fns.empty()){
+      auto it = g_plugin_fns.find(upper(qname));
+      if(it != g_plugin_fns.end()) f = it->second.get();
+    }
+  }
+  b.fn.store(f, std::memory_order_relaxed);
+  b.gen.store(gen, std::memory_order_release);
+  return f;
+}
+
+Value plugin_call(const PluginFn& f, const std::vector<Value>& args){
+  // arity from the parameter signature
+  const std::string& p = f.params;
+  bool variadic = !p.empty() && p.back()=='*';
+  size_t fixed = variadic ? p.size()-1 : p.size();
+  if(args.size() < (variadic ? fixed-1 : fixed) || (!variadic && args.size() != fixed)) return Value{};
+
+  std::vector<std::string> strs(args.size());
+  std::vector<pb_value> in(args.size());
+  for(size_t i=0;i<args.size();++i){
+    char want = (i < fixed) ? p[i] : p[fixed-1];
+    pb_value& v = in[i];
+    v = pb_value{PB_NIL, 0.0, nullptr, 0};
+    const Value& a = args[i];
+    if(want=='n' || (want=='v' && std::holds_alternative<Number>(a))){
+      v.kind = PB_NUM;
+      v.num  = std::holds_alternative<Number>(a) ? std::get<Number>(a) : std::atof(to_string(a).c_str());
+    } else if(want=='s' || std::holds_alternative<std::string>(a)){
+      strs[i] = to_string(a);
+      v.kind = PB_STR; v.str = strs[i].c_str(); v.len = strs[i].size();
+    }
+  }
+
+  pb_result out;
+  int rc = f.fn(&g_host_api, in.data(), in.size(), &out, f.userdata);
+  return rc == 0 ? out.v : Value{};
+}
+
+/* ---------------- loading ---------------- */
+
+bool plugin_load(const std::string& path, std::string* err){
+#ifndef _WIN32
+  std::error_code ec;
+  std::string key = fs::weakly_canonical(path, ec).string();
+  if(key.empty()) key = path;
+  {
+    std::lock_guard<std::mutex> lk(g_plugins_mu);
+    if(g_plugin_paths.count(key)) return true;
+  }
+  void* h = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if(!h){ if(err) *err = dlerror(); return false; }
+  // check the ABI before running any of its code
+  auto abi = static_cast<const unsigned*>(dlsym(h, PB_PLUGIN_ABI_SYMBOL));
+  if(!abi || *abi != PB_PLUGIN_ABI_VERSION){
+    if(err) *err = abi ? "plugin ABI version " + std::to_string(*abi) + ", expected " + std::to_string(PB_PLUGIN_ABI_VERSION)
+                       : std::string("missing " PB_PLUGIN_ABI_SYMBOL);
+    dlclose(h);
+    return false;
+  }
+  using InitFn = int (*)(const pb_host_api*, pb_registrar*);
+  auto init = reinterpret_cast<InitFn>(dlsym(h, PB_PLUGIN_ENTRY));
+  if(!init){ if(err) *err = "missing " PB_PLUGIN_ENTRY; dlclose(h); return false; }
+
+  pb_registrar reg; reg.path = path;
+  if(init(&g_host_api, &reg) != 0 || reg.namespaces.empty()){
+    // functions it did register stay valid: the object is never unloaded
+    if(err) *err = "plugin init failed";
+    return false;
+  }
+  std::string info = key + ":";
+  for(const auto& ns : reg.namespaces) info += " " + ns;
+  std::lock_guard<std::mutex> lk(g_plugins_mu);
+  g_plugin_paths.insert(key);
+  g_plugin_info.push_back(info);
+  return true;
+#else
+  (void)path;
+  if(err) *err = "plugins are not supported on this platform";
+  return false;
+#endif
+}
+
+// Plugins run inside the shell process, so they only come from absolute
+// user and system directories: never from one relative to the working
+// directory (a checked-out repo must not get to run code in the shell).
+static std::vector<fs::path> plugin_search_paths(){
+  std::vector<fs::path> dirs;
+  if(const char* home = std::getenv("HOME")){
+    fs::path user = fs::path(home) / ".config/prismshell/plugins";
+    if(user.is_absolute()) dirs.push_back(std::move(user));
+  }
+  dirs.emplace_back("/usr/local/share/prismshell/plugins");
+  dirs.emplace_back("/usr/share/prismshell/plugins");
+  if(const char* extra = std::getenv("PRISMSHELL_PLUGIN_PATH")){
+    std::string s = extra; size_t start = 0;
+    while(true){
+      size_t sep = s.find(':', start);
+      std::string chunk = (sep==std::string::npos) ? s.substr(start) : s.substr(start, sep-start);
+      if(!chunk.empty() && fs::path(chunk).is_absolute()) dirs.emplace_back(chunk);
+      if(sep==std::string::npos) break;
+      start = sep+1;
+    }
+  }
+  return dirs;
+}
+
+void plugins_autoload(){
+  for(const auto& dir : plugin_search_paths()){
+    std::error_code ec;
+    if(!fs::is_directory(dir, ec)) continue;
+    std::vector<fs::path> files;
+    for(auto it = fs::directory_iterator(dir, ec); !ec && it!=fs::end(it); it.increment(ec)){
+      if(it->is_regular_file() && it->path().extension() == ".so") files.push_back(it->path());
+    }
+    std::sort(files.begin(), files.end());
+    for(const auto& p : files){
+      std::string err;
+      if(!plugin_load(p.string(), &err)) std::cerr << "Plugin load error in " << p << ": " << err << "\n";
+    }
+  }
+}
+
+std::vector<std::string> plugin_list(){
+  std::lock_guard<std::mutex> lk(g_plugins_mu);
+  return g_plugin_info;
+}
+
+} // namespace pb
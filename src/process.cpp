@@ -0,0 +1,1409 @@
+#include "prismshell/process.hpp"
+#include "prismshell/glob.hpp"
+#include "prismshell/utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#ifndef _WIN32
+  #include <csignal>
+  #include <fcntl.h>
+  #include <spawn.h>
+  #include <sys/stat.h>
+  #include <pthread.h>
+  #include <sys/wait.h>
+  #include <termios.h>
+  #include <unistd.h>
+  #ifdef __linux__
+    #include <sys/signalfd.h>
+  #endif
+  #if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+    #define PB_HAVE_SPAWN_TCSETPGRP 1   // posix_spawn_file_actions_addtcsetpgrp_np
+  #endif
+  extern char** environ;
+#endif
+
+namespace pb {
+
+// ---- parsing ------------------------------------------------------------------
+
+// First words the launcher must not exec: shell keywords and builtins that
+// either have no binary or only make sense inside the shell process.
+static bool shell_only_word(const std::string& w){
+  static const char* const kWords[] = {
+    "!", "{", "}", "[[", "if", "then", "else", "elif", "fi", "for", "while", "until",
+    "do", "done", "case", "esac", "function", "select", ":", ".", "source", "export",
+    "unset", "alias", "unalias", "set", "shift", "eval", "exec", "exit", "return",
+    "read", "readonly", "local", "trap", "ulimit", "umask", "wait", "jobs", "fg",
+    "bg", "hash", "type", "command", "builtin", "times", "getopts", "break",
+    "continue", "let", "declare", "typeset",
+  };
+  for(const char* k : kWords) if(w == k) return true;
+  return false;
+}
+
+static bool all_digits(const std::string& s){
+  if(s.empty()) return false;
+  for(char c : s) if(!std::isdigit((unsigned char)c)) return false;
+  return true;
+}
+
+// Single pass over the line. Quoting follows tokenize_quoted ("double",
+// 'single', backslash), except that empty quoted words are kept. Words with
+// unquoted `*`, `?` or `[` go through glob_expand() with sh's rules (no
+// braces, `**` is `*`); a pattern that matches nothing stays as it is.
+bool parse_pipeline(const std::string& line, std::vector<Stage>& out){
+  out.clear();
+  out.emplace_back();
+  std::string word;
+  std::string pattern;      // the word with its quoted glob characters escaped
+  bool have_word=false;     // word started (possibly empty "")
+  bool word_quoted=false;   // any part of it was quoted/escaped
+  bool word_glob=false;     // it has an unquoted glob character
+  Redirect* pending=nullptr;  // redirect waiting for its target word
+
+  auto add_quoted = [&](char d){
+    word.push_back(d);
+    if(d=='*' || d=='?' || d=='[' || d=='\\') pattern.push_back('\\');
+    pattern.push_back(d);
+  };
+
+  auto finish_word = [&]() -> bool {
+    if(!have_word) return true;
+    Stage& st = out.back();
+    if(pending){
+      if(word_glob) return false;   // sh decides how a redirect target expands
+      if(pending->kind == Redirect::Dup){
+        if(word_quoted || !all_digits(word)) return false;   // N>&- etc.
+        pending->target = std::atoi(word.c_str());
+      } else {
+        pending->path = word;
+      }
+      pending = nullptr;
+    } else {
+      if(st.argv.empty() && shell_only_word(word)) return false;
+      std::vector<std::string> names;
+      if(word_glob){
+        GlobOptions sh_rules; sh_rules.braces = false; sh_rules.globstar = false;
+        names = glob_expand(pattern, sh_rules);
+      }
+      if(names.empty()) st.argv.push_back(word);
+      else st.argv.insert(st.argv.end(), names.begin(), names.end());
+    }
+    word.clear(); pattern.clear(); have_word=false; word_quoted=false; word_glob=false;
+    return true;
+  };
+
+  for(size_t i=0;i<line.size();++i){
+    char c=line[i];
+    if(c=='\''){
+      size_t end = line.find('\'', i+1);
+      if(end==std::string::npos) return false;   // let sh report it
+      for(size_t j=i+1;j<end;++j) add_quoted(line[j]);
+      have_word=word_quoted=true; i=end; continue;
+    }
+    if(c=='"'){
+      size_t j=i+1;
+      for(; j<line.size() && line[j]!='"'; ++j){
+        char d=line[j];
+        if(d=='$' || d=='`') return false;
+        if(d=='\\'){
+          // sh keeps the backslash before anything but $ ` " \ newline
+          char n = (j+1<line.size()) ? line[j+1] : '\0';
+          if(n=='\n') return false;
+          if(n=='$' || n=='`' || n=='"' || n=='\\'){ d=n; ++j; }
+        }
+        add_quoted(d);
+      }
+      if(j>=line.size()) return false;
+      have_word=word_quoted=true; i=j; continue;
+    }
+    if(c=='\\'){
+      if(i+1>=line.size() || line[i+1]=='\n') return false;
+      add_quoted(line[++i]); have_word=word_quoted=true; continue;
+    }
+    if(c=='\n') return false;
+    if(std::isspace((unsigned char)c)){ if(!finish_word()) return false; continue; }
+
+    if(c=='|'){
+      if(i+1<line.size() && line[i+1]=='|') return false;   // ||
+      if(!finish_word() || pending) return false;
+      if(out.back().argv.empty()) return false;
+      out.emplace_back();
+      continue;
+    }
+    if(c=='<' || c=='>'){
+      // A bare run of digits right before the operator is the fd number
+      int fd = (c=='<') ? 0 : 1;
+      if(have_word && !word_quoted && all_digits(word)){ fd = std::atoi(word.c_str()); word.clear(); pattern.clear(); have_word=false; }
+      else if(!finish_word()) return false;
+      if(pending) return false;
+      Redirect r; r.fd = fd;
+      char n = (i+1<line.size()) ? line[i+1] : '\0';
+      if(c=='<'){
+        if(n=='<' || n=='>') return false;              // here-docs, <>
+        if(n=='&'){ r.kind=Redirect::Dup; ++i; }
+        else r.kind=Redirect::In;
+      } else {
+        if(n=='>'){ r.kind=Redirect::Append; ++i; }
+        else if(n=='&'){ r.kind=Redirect::Dup; ++i; }
+        else if(n=='|'){ r.kind=Redirect::Out; ++i; }   // >| : clobber
+        else r.kind=Redirect::Out;
+      }
+      out.back().redirs.push_back(r);
+      pending = &out.back().redirs.back();
+      continue;
+    }
+    switch(c){
+      case '$': case '`': case '&': case ';': case '(': case ')':
+        return false;
+      case '*': case '?': case '[':
+        word_glob = true;
+        break;
+      case '#': case '~':
+        if(!have_word) return false;   // comment, tilde expansion
+        break;
+      case '=':
+        if(!pending && out.back().argv.empty()) return false;   // FOO=bar cmd
+        break;
+      default: break;
+    }
+    word.push_back(c); pattern.push_back(c); have_word=true;
+  }
+  if(!finish_word() || pending) return false;
+  for(const auto& st : out) if(st.argv.empty()) return false;   // "> f", "a |"
+  return true;
+}
+
+bool needs_shell(const std::string& line){
+  std::vector<Stage> st;
+  return !parse_pipeline(line, st);
+}
+
+// ---- spawning -----------------------------------------------------------------
+
+#ifndef _WIN32
+
+static bool is_executable_file(const std::string& p){
+  struct stat st{};
+  return ::stat(p.c_str(), &st)==0 && S_ISREG(st.st_mode) && ::access(p.c_str(), X_OK)==0;
+}
+
+static std::vector<std::string> path_dirs(const std::string& path){
+  std::vector<std::string> dirs;
+  size_t start = 0;
+  while(true){
+    size_t sep = path.find(':', start);
+    std::string dir = (sep==std::string::npos) ? path.substr(start) : path.substr(start, sep-start);
+    dirs.push_back(dir.empty() ? std::string(".") : dir);   // empty entry = cwd
+    if(sep==std::string::npos) break;
+    start = sep+1;
+  }
+  return dirs;
+}
+
+static std::string current_path_var(){
+  const char* env = std::getenv("PATH");
+  return env ? env : "/usr/local/bin:/usr/bin:/bin";
+}
+
+// Hash and completion index share one lock; mod pipeline stages resolve
+// programs from worker threads.
+static std::mutex g_hash_mu;
+static std::string g_hash_for;                          // PATH the table was built for
+static std::map<std::string, HashedCommand> g_hash;
+
+struct PathIndex {
+  std::string for_path;
+  std::vector<std::pair<std::string, struct timespec>> dirs;   // dir, mtime
+  std::set<std::string> names;
+};
+static PathIndex g_index;
+
+// Caller holds g_hash_mu.
+static void hash_sync_path(){
+  std::string p = current_path_var();
+  if(p != g_hash_for){ g_hash.clear(); g_hash_for = p; }
+}
+
+static std::string hash_lookup(const std::string& name, bool hit){
+  if(name.empty()) return "";
+  if(name.find('/') != std::string::npos) return name;
+  {
+    std::lock_guard<std::mutex> lk(g_hash_mu);
+    hash_sync_path();
+    auto it = g_hash.find(name);
+    if(it != g_hash.end()){
+      if(is_executable_file(it->second.path)){
+        if(hit) ++it->second.hits;
+        return it->second.path;
+      }
+      g_hash.erase(it);   // moved or deleted: search again
+    }
+  }
+
+  std::string path = current_path_var(), found;
+  for(const auto& dir : path_dirs(path)){
+    std::string cand = dir + "/" + name;
+    if(is_executable_file(cand)){ found = cand; break; }
+  }
+  if(found.empty()) return "";
+
+  std::lock_guard<std::mutex> lk(g_hash_mu);
+  hash_sync_path();
+  if(g_hash_for == path){
+    HashedCommand& h = g_hash[name];
+    h.name = name; h.path = found;
+    if(hit) ++h.hits;
+  }
+  return found;
+}
+
+std::string resolve_program(const std::string& name){ return hash_lookup(name, true); }
+std::string command_hash_add(const std::string& name){ return hash_lookup(name, false); }
+
+std::vector<HashedCommand> command_hash_list(){
+  std::lock_guard<std::mutex> lk(g_hash_mu);
+  hash_sync_path();
+  std::vector<HashedCommand> out;
+  for(const auto& kv : g_hash) out.push_back(kv.second);
+  return out;
+}
+
+bool command_hash_forget(const std::string& name){
+  std::lock_guard<std::mutex> lk(g_hash_mu);
+  return g_hash.erase(name) > 0;
+}
+
+void command_hash_clear(){
+  std::lock_guard<std::mutex> lk(g_hash_mu);
+  g_hash.clear();
+  g_index = PathIndex{};
+}
+
+static bool same_mtime(const struct timespec& a, const struct timespec& b){
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+std::vector<std::string> path_commands(const std::string& prefix){
+  std::lock_guard<std::mutex> lk(g_hash_mu);
+  std::string path = current_path_var();
+
+  bool fresh = (g_index.for_path == path);
+  for(size_t i=0; fresh && i<g_index.dirs.size(); ++i){
+    struct stat st{};
+    fresh = ::stat(g_index.dirs[i].first.c_str(), &st)==0 && same_mtime(st.st_mtim, g_index.dirs[i].second);
+  }
+  if(!fresh){
+    g_index = PathIndex{};
+    g_index.for_path = path;
+    for(const auto& dir : path_dirs(path)){
+      struct stat st{};
+      if(::stat(dir.c_str(), &st) != 0) continue;
+      g_index.dirs.emplace_back(dir, st.st_mtim);
+      std::error_code ec;
+      for(auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)){
+        std::string full = it->path().string();
+        if(is_executable_file(full)) g_index.names.insert(it->path().filename().string());
+      }
+    }
+  }
+
+  std::vector<std::string> out;
+  for(auto it = g_index.names.lower_bound(prefix); it != g_index.names.end() && starts_with(*it, prefix); ++it)
+    out.push_back(*it);
+  return out;
+}
+
+int wait_status_code(int status){
+  if(WIFEXITED(status))   return WEXITSTATUS(status);
+  if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+  return 1;
+}
+
+// posix_spawn with default signal dispositions and an empty mask. The shell
+// ignores SIGQUIT/SIGPIPE (and SIGINT while waiting); ignored dispositions
+// survive exec. `pgid` 0 starts a new process group, >0 joins one, -1 stays
+// in the shell's. Returns 0 or an errno value; ENOEXEC retries through sh.
+static int spawn_child(const std::string& path, const std::vector<std::string>& argv,
+                       const posix_spawn_file_actions_t* fa, pid_t* pid, pid_t pgid = -1){
+  std::vector<char*> cargv;
+  cargv.reserve(argv.size()+1);
+  for(const auto& a : argv) cargv.push_back(const_cast<char*>(a.c_str()));
+  cargv.push_back(nullptr);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t defaults, empty;
+  sigemptyset(&defaults);
+  for(int sig : {SIGINT, SIGQUIT, SIGPIPE, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD}) sigaddset(&defaults, sig);
+  sigemptyset(&empty);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setsigmask(&attr, &empty);
+  short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+  if(pgid >= 0){
+    posix_spawnattr_setpgroup(&attr, pgid);
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  posix_spawnattr_setflags(&attr, flags);
+
+  int rc = posix_spawn(pid, path.c_str(), fa, &attr, cargv.data(), environ);
+  posix_spawnattr_destroy(&attr);
+
+  if(rc == ENOEXEC){
+    // No #! line: sh runs it as a script, like execvp would
+    std::vector<std::string> sh = {"sh", path};
+    sh.insert(sh.end(), argv.begin()+1, argv.end());
+    return spawn_child("/bin/sh", sh, fa, pid, pgid);
+  }
+  // Also set it from the parent, so the group exists before we hand it the
+  // terminal (fails harmlessly once the child has exec'd)
+  if(rc == 0 && pgid >= 0) setpgid(*pid, pgid ? pgid : *pid);
+  return rc;
+}
+
+static int spawn_error_status(const std::string& name, int rc){
+  std::cerr << name << ": " << std::strerror(rc) << "\n";
+  return (rc==ENOENT) ? 127 : 126;
+}
+
+// Killed by a signal other than the ones a user sends on purpose: say so.
+static void report_signal(int status){
+  if(!WIFSIGNALED(status)) return;
+  int sig = WTERMSIG(status);
+  if(sig == SIGINT || sig == SIGPIPE) return;
+  std::cerr << strsignal(sig);
+  if(WCOREDUMP(status)) std::cerr << " (core dumped)";
+  std::cerr << "\n";
+}
+
+static int wait_child(pid_t pid){
+  int status = 0;
+  while(waitpid(pid, &status, 0) < 0){
+    if(errno != EINTR) return 1;
+  }
+  report_signal(status);
+  return wait_status_code(status);
+}
+
+int spawn_wait(const std::string& path, const std::vector<std::string>& argv){
+  std::cout.flush();  // keep PRINT output ordered before the child's
+  pid_t pid = -1;
+  int rc = spawn_child(path, argv, nullptr, &pid);
+  if(rc != 0) return spawn_error_status(argv[0], rc);
+  return wait_child(pid);
+}
+
+static int open_flags(Redirect::Kind k){
+  switch(k){
+    case Redirect::In:     return O_RDONLY;
+    case Redirect::Append: return O_WRONLY | O_CREAT | O_APPEND;
+    default:               return O_WRONLY | O_CREAT | O_TRUNC;
+  }
+}
+
+// ---- job control ----------------------------------------------------------------
+//
+// With a terminal, every line the launcher runs gets its own process group,
+// and a foreground group owns the terminal while it runs: Ctrl-C and Ctrl-Z
+// reach that job only (the shell ignores SIGTSTP/SIGTTIN/SIGTTOU). Background
+// jobs (`cmd &`) and stopped ones are kept in the job table. SIGCHLD stays
+// blocked and is read from a signalfd; jobs_notify() reaps when one arrived
+// and reports what changed before the next prompt.
+
+namespace {
+struct Job {
+  enum State { Running, Stopped, Done };
+  int id{0};
+  pid_t pgid{-1};
+  std::vector<pid_t> pids;   // external stages; -1 once reaped (or never started)
+  pid_t last{-1};            // the stage whose status is the job's
+  int status{0};
+  int termsig{0};            // last stage was killed by this signal
+  State state{Running};
+  bool notify{false};        // state change not reported yet
+  bool have_tmodes{false};   // terminal modes saved when it stopped
+  struct termios tmodes{};
+  std::string cmd;
+};
+}
+
+static std::mutex g_jobs_mu;
+static std::vector<Job> g_jobs;          // the current job (%+) is last
+static bool g_job_control = false;       // stdin is our controlling terminal
+static pid_t g_shell_pgid = -1;
+static struct termios g_shell_tmodes;
+static int g_sigchld_fd = -1;
+
+void jobs_init(){
+  static std::once_flag once;
+  std::call_once(once, []{
+#ifdef __linux__
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &chld, nullptr);   // threads started later inherit it
+    g_sigchld_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+#endif
+    if(!isatty(STDIN_FILENO)) return;
+    // Like any job-control shell, wait until we are in the foreground
+    pid_t fg;
+    while((fg = tcgetpgrp(STDIN_FILENO)) >= 0 && fg != getpgrp()) kill(-getpgrp(), SIGTTIN);
+    if(fg < 0) return;
+    std::signal(SIGTSTP, SIG_IGN);
+    std::signal(SIGTTIN, SIG_IGN);
+    std::signal(SIGTTOU, SIG_IGN);
+    if(getpgrp() != getpid()) setpgid(0, 0);   // fails for a session leader, which is fine
+    g_shell_pgid = getpgrp();
+    tcsetpgrp(STDIN_FILENO, g_shell_pgid);
+    tcgetattr(STDIN_FILENO, &g_shell_tmodes);
+    g_job_control = true;
+  });
+}
+
+// A new foreground job takes the terminal in its first child, after joining
+// its new process group and before exec, so a program that uses the tty at
+// once (less, vim, an ssh password prompt) never meets SIGTTIN/SIGTTOU.
+// foreground() hands it over from the parent as well, which is all other
+// libcs get. Returns whether the action was added.
+static bool add_terminal_handoff(posix_spawn_file_actions_t* fa){
+#ifdef PB_HAVE_SPAWN_TCSETPGRP
+  return g_job_control && posix_spawn_file_actions_addtcsetpgrp_np(fa, STDIN_FILENO) == 0;
+#else
+  (void)fa;
+  return false;
+#endif
+}
+
+// The child took the terminal but never exec'd: take it back.
+static void undo_terminal_handoff(){
+  if(g_job_control) tcsetpgrp(STDIN_FILENO, g_shell_pgid);
+}
+
+static void give_terminal(const Job& j){
+  if(!g_job_control || j.pgid <= 0) return;
+  if(j.have_tmodes) tcsetattr(STDIN_FILENO, TCSADRAIN, &j.tmodes);
+  tcsetpgrp(STDIN_FILENO, j.pgid);
+}
+
+static void take_terminal(Job& j){
+  if(!g_job_control || j.pgid <= 0) return;
+  tcsetpgrp(STDIN_FILENO, g_shell_pgid);
+  j.have_tmodes = tcgetattr(STDIN_FILENO, &j.tmodes) == 0;
+  tcsetattr(STDIN_FILENO, TCSADRAIN, &g_shell_tmodes);
+}
+
+// Fold one waitpid() result for j.pids[i] into the job.
+static void job_update(Job& j, size_t i, int st){
+  if(WIFSTOPPED(st)){ j.state = Job::Stopped; j.status = 128 + WSTOPSIG(st); return; }
+  if(WIFCONTINUED(st)){ j.state = Job::Running; return; }
+  if(j.pids[i] == j.last){
+    j.status = wait_status_code(st);
+    j.termsig = WIFSIGNALED(st) ? WTERMSIG(st) : 0;
+  }
+  j.pids[i] = -1;
+  if(std::all_of(j.pids.begin(), j.pids.end(), [](pid_t p){ return p < 0; })) j.state = Job::Done;
+}
+
+// Block until the job is done or, with `untraced`, stopped. False if a SIGINT
+// cut the wait short (only when `interruptible`).
+static bool wait_job(Job& j, bool untraced, bool interruptible, bool foreground){
+  for(size_t i=0;i<j.pids.size();++i){
+    while(j.pids[i] > 0){
+      int st = 0;
+      if(waitpid(j.pids[i], &st, untraced ? WUNTRACED : 0) < 0){
+        if(errno == EINTR){
+          if(interruptible) return false;
+          continue;
+        }
+        j.pids[i] = -1;   // reaped elsewhere
+        break;
+      }
+      if(foreground) report_signal(st);
+      job_update(j, i, st);
+      if(j.state == Job::Stopped) return true;
+    }
+  }
+  j.state = Job::Done;
+  return true;
+}
+
+static int next_job_id_locked(){
+  int id = 0;
+  for(const auto& j : g_jobs) id = std::max(id, j.id);
+  return id + 1;
+}
+
+static std::string job_line(const Job& j, char mark){
+  std::string state;
+  switch(j.state){
+    case Job::Running: state = "Running"; break;
+    case Job::Stopped: state = "Stopped"; break;
+    case Job::Done:
+      if(j.termsig)         state = strsignal(j.termsig);
+      else if(j.status==0)  state = "Done";
+      else                  state = "Exit " + std::to_string(j.status);
+      break;
+  }
+  std::string out = "[" + std::to_string(j.id) + "]" + mark + "  " + state;
+  if(out.size() < 30) out.append(30 - out.size(), ' ');
+  else out += ' ';
+  return out + j.cmd;
+}
+
+static char job_mark_locked(size_t idx){
+  if(idx + 1 == g_jobs.size()) return '+';
+  if(idx + 2 == g_jobs.size()) return '-';
+  return ' ';
+}
+
+// Wait for a started job in the foreground; one that stops joins the table.
+static int foreground(Job j, bool untraced){
+  give_terminal(j);
+  wait_job(j, untraced, false, true);
+  take_terminal(j);
+  if(g_job_control && j.termsig == SIGINT) std::cout << "\n";   // end the ^C line
+  if(j.state != Job::Stopped) return j.status;
+  std::lock_guard<std::mutex> lk(g_jobs_mu);
+  if(!j.id) j.id = next_job_id_locked();
+  j.notify = false;
+  std::cout << "\n" << job_line(j, '+') << "\n";
+  int status = j.status;
+  g_jobs.push_back(std::move(j));
+  return status;
+}
+
+// Collect state changes of table jobs without blocking.
+static void reap_jobs_locked(){
+  for(auto& j : g_jobs){
+    if(j.state == Job::Done) continue;
+    Job::State before = j.state;
+    for(size_t i=0;i<j.pids.size();++i){
+      int st = 0;
+      while(j.pids[i] > 0 && waitpid(j.pids[i], &st, WNOHANG | WUNTRACED | WCONTINUED) > 0)
+        job_update(j, i, st);
+    }
+    if(j.state != before && j.state != Job::Running) j.notify = true;
+  }
+}
+
+// Report and drop finished jobs; report newly stopped ones.
+static void print_changes_locked(){
+  for(size_t i=0;i<g_jobs.size();++i)
+    if(g_jobs[i].notify){ std::cout << job_line(g_jobs[i], job_mark_locked(i)) << "\n"; g_jobs[i].notify = false; }
+  g_jobs.erase(std::remove_if(g_jobs.begin(), g_jobs.end(), [](const Job& j){ return j.state == Job::Done; }),
+               g_jobs.end());
+}
+
+void jobs_notify(){
+  bool pending = false;
+  if(g_sigchld_fd >= 0){
+#ifdef __linux__
+    struct signalfd_siginfo si;
+    while(::read(g_sigchld_fd, &si, sizeof si) == (ssize_t)sizeof si) pending = true;
+#endif
+  } else {
+    pending = true;   // no signalfd: poll
+  }
+  std::lock_guard<std::mutex> lk(g_jobs_mu);
+  if(pending && !g_jobs.empty()) reap_jobs_locked();
+  print_changes_locked();
+}
+
+void jobs_shutdown(){
+  // Stopped jobs would never run again: hang them up, then wake them to see it
+  std::lock_guard<std::mutex> lk(g_jobs_mu);
+  for(const auto& j : g_jobs){
+    if(j.state != Job::Stopped || j.pgid <= 0) continue;
+    kill(-j.pgid, SIGHUP);
+    kill(-j.pgid, SIGCONT);
+  }
+}
+
+// Start the stages without waiting. External ones go into one process group
+// when `group` is set, which gets the terminal with `tty` (a foreground job
+// under job control), and get /dev/null as stdin with `null_stdin`. The last
+// stage writes to `out_fd` (taken over) if it is not -1. In-process stages run
+// on `threads`, writing their status into `status` (one slot per stage, also
+// set for stages that failed to start); both must outlive them.
+static bool launch_pipeline(const std::vector<Stage>& stages, const InProcStages* inproc,
+                            bool group, bool tty, bool null_stdin, int out_fd, Job& job,
+                            std::vector<int>& status, std::vector<std::thread>& threads){
+  const size_t n = stages.size();
+  std::cout.flush();
+
+  // pipes[i] connects stage i -> i+1; O_CLOEXEC so no child keeps stray ends
+  std::vector<int> rd(n, -1), wr(n, -1);
+  wr[n-1] = out_fd;
+  for(size_t i=0;i+1<n;++i){
+    int p[2];
+    if(pipe2(p, O_CLOEXEC) != 0){
+      std::cerr << "pipe: " << std::strerror(errno) << "\n";
+      for(size_t j=0;j<i;++j){ ::close(rd[j+1]); ::close(wr[j]); }
+      if(out_fd >= 0) ::close(out_fd);
+      return false;
+    }
+    wr[i] = p[1]; rd[i+1] = p[0];
+  }
+
+  job.pids.assign(n, -1);
+  status.assign(n, 0);
+  job.pgid = -1;
+
+  for(size_t i=0;i<n;++i){
+    const Stage& st = stages[i];
+    int in_fd = rd[i], out_fd = wr[i];
+    rd[i] = wr[i] = -1;   // ownership moves to the stage
+
+    if(inproc && inproc->handles && inproc->handles(st.argv[0])){
+      // In-process stage: apply stdin/stdout file redirects here; other fds
+      // belong to the shell and are left alone.
+      bool ok = true;
+      for(const auto& r : st.redirs){
+        if(r.kind == Redirect::Dup || (r.fd != 0 && r.fd != 1)) continue;
+        int f = ::open(r.path.c_str(), open_flags(r.kind) | O_CLOEXEC, 0666);
+        if(f < 0){ std::cerr << r.path << ": " << std::strerror(errno) << "\n"; ok = false; break; }
+        int& slot = (r.fd == 0) ? in_fd : out_fd;
+        if(slot >= 0) ::close(slot);
+        slot = f;
+      }
+      if(!ok){
+        if(in_fd >= 0) ::close(in_fd);
+        if(out_fd >= 0) ::close(out_fd);
+        status[i] = 1;
+        continue;
+      }
+      threads.emplace_back([&stages, &status, inproc, i, in_fd, out_fd]{
+        status[i] = inproc->run(stages[i].argv, in_fd, out_fd);
+        if(in_fd >= 0)  ::close(in_fd);
+        if(out_fd >= 0) ::close(out_fd);   // EOF for the next stage
+      });
+      continue;
+    }
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    if(in_fd >= 0)  posix_spawn_file_actions_adddup2(&fa, in_fd, 0);
+    else if(i == 0 && null_stdin) posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    if(out_fd >= 0) posix_spawn_file_actions_adddup2(&fa, out_fd, 1);
+    for(const auto& r : st.redirs){
+      if(r.kind == Redirect::Dup) posix_spawn_file_actions_adddup2(&fa, r.target, r.fd);
+      else posix_spawn_file_actions_addopen(&fa, r.fd, r.path.c_str(), open_flags(r.kind), 0666);
+    }
+
+    std::string path = resolve_program(st.argv[0]);
+    pid_t pgid = group ? std::max<pid_t>(job.pgid, 0) : -1;
+    bool handoff = !path.empty() && tty && pgid == 0 && add_terminal_handoff(&fa);
+    if(path.empty()){
+      std::cerr << st.argv[0] << ": command not found\n";
+      status[i] = 127;
+    } else if(int rc = spawn_child(path, st.argv, &fa, &job.pids[i], pgid); rc != 0){
+      if(handoff) undo_terminal_handoff();
+      status[i] = spawn_error_status(st.argv[0], rc);
+      job.pids[i] = -1;
+    } else if(group && job.pgid < 0){
+      job.pgid = job.pids[i];
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    if(in_fd >= 0)  ::close(in_fd);
+    if(out_fd >= 0) ::close(out_fd);
+  }
+  job.last = job.pids[n-1];
+  job.status = status[n-1];
+  return true;
+}
+
+int run_pipeline(const std::vector<Stage>& stages, const InProcStages* inproc, const std::string& cmd){
+  Job job;
+  std::vector<int> status;
+  std::vector<std::thread> threads;
+  if(!launch_pipeline(stages, inproc, g_job_control, true, false, -1, job, status, threads)) return 1;
+  job.cmd = cmd;
+  if(job.cmd.empty())
+    for(const auto& st : stages)
+      for(const auto& a : st.argv) job.cmd += (job.cmd.empty() ? "" : " ") + a;
+
+  // Threads of in-process stages are joined here, so such a pipeline cannot
+  // be suspended: Ctrl-Z is only honoured for all-external ones.
+  bool last_inproc = job.last < 0;
+  int rc = foreground(std::move(job), threads.empty());
+  for(auto& t : threads) t.join();
+  return last_inproc ? status.back() : rc;
+}
+
+// ---- persistent sh coprocess ---------------------------------------------------
+//
+// One long-lived /bin/sh reads commands from a pipe. Its fd 3 is a status pipe
+// back to us and fd 4 keeps the shell's real stdin for the commands. Each line
+// is sent as
+//
+//   { command eval '<line>'
+//   } 0<&4 3>&- 4<&-; __pb_s=$?; printf '%s %s %s\n' <token> "$__pb_s" "$PWD" >&3
+//
+// `command eval` keeps syntax errors from killing the shell; the brace group
+// (not a subshell) lets variables, functions and cd persist.
+
+namespace {
+struct Coproc {
+  pid_t pid{-1};
+  int cmd_fd{-1};       // -> sh stdin
+  int status_fd{-1};    // <- sh fd 3
+  std::string token;    // per-session sentinel prefix
+  unsigned long seq{0};
+  std::string cwd;      // sh's cwd as last reported
+  std::string buf;      // unread status bytes
+};
+}
+
+static std::mutex g_coproc_mu;
+static Coproc g_coproc;
+
+bool coproc_enabled(){
+  const char* v = std::getenv("PRISMSHELL_COPROC");
+  return v && *v && std::strcmp(v, "0") != 0;
+}
+
+static std::string sh_quote(const std::string& s){
+  std::string out = "'";
+  for(char c : s){ if(c=='\'') out += "'\\''"; else out.push_back(c); }
+  out += "'";
+  return out;
+}
+
+static bool write_all(int fd, const std::string& s){
+  const char* p = s.data(); size_t n = s.size();
+  while(n){
+    ssize_t w = ::write(fd, p, n);
+    if(w < 0){ if(errno == EINTR) continue; return false; }
+    p += w; n -= (size_t)w;
+  }
+  return true;
+}
+
+// Close our ends and reap the shell; returns its status (or -1 if none).
+static int coproc_stop(Coproc& c){
+  if(c.cmd_fd >= 0) ::close(c.cmd_fd);
+  if(c.status_fd >= 0) ::close(c.status_fd);
+  int code = -1;
+  if(c.pid > 0){
+    int st = 0;
+    while(waitpid(c.pid, &st, 0) < 0 && errno == EINTR){}
+    code = wait_status_code(st);
+  }
+  c = Coproc{};
+  return code;
+}
+
+// Move an fd out of the 0..9 range the file actions below write to.
+static int high_fd(int fd){
+  int h = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+  if(h < 0) return fd;
+  ::close(fd);
+  return h;
+}
+
+static bool coproc_start(Coproc& c){
+  int in[2], st[2];
+  if(pipe2(in, O_CLOEXEC) != 0) return false;
+  if(pipe2(st, O_CLOEXEC) != 0){ ::close(in[0]); ::close(in[1]); return false; }
+  in[0] = high_fd(in[0]);   // must not be 4 when stdin is copied there
+  st[1] = high_fd(st[1]);
+
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_adddup2(&fa, 0, 4);       // real stdin, before 0 is replaced
+  posix_spawn_file_actions_adddup2(&fa, in[0], 0);
+  posix_spawn_file_actions_adddup2(&fa, st[1], 3);
+  pid_t pid = -1;
+  int rc = spawn_child("/bin/sh", {"sh"}, &fa, &pid);
+  posix_spawn_file_actions_destroy(&fa);
+  ::close(in[0]); ::close(st[1]);
+  if(rc != 0){ ::close(in[1]); ::close(st[0]); return false; }
+
+  c.pid = pid; c.cmd_fd = in[1]; c.status_fd = st[0];
+  c.token = "__pb_done_" + std::to_string((long)getpid()) + "_" + std::to_string((long)pid);
+  // Ctrl-C interrupts the running command, not the coprocess itself
+  return write_all(c.cmd_fd, "trap ':' INT\n");
+}
+
+// Read status lines until the one for `want`; false on EOF (shell exited).
+static bool coproc_wait(Coproc& c, const std::string& want, int* status, std::string* pwd){
+  while(true){
+    size_t nl;
+    while((nl = c.buf.find('\n')) != std::string::npos){
+      std::string ln = c.buf.substr(0, nl);
+      c.buf.erase(0, nl+1);
+      if(ln.compare(0, want.size()+1, want + " ") != 0) continue;   // stale line
+      size_t sp = ln.find(' ', want.size()+1);
+      *status = std::atoi(ln.c_str() + want.size() + 1);
+      *pwd = (sp == std::string::npos) ? std::string() : ln.substr(sp+1);
+      return true;
+    }
+    char tmp[512];
+    ssize_t r = ::read(c.status_fd, tmp, sizeof tmp);
+    if(r < 0 && errno == EINTR) continue;
+    if(r <= 0) return false;
+    c.buf.append(tmp, (size_t)r);
+  }
+}
+
+// Follow a `cd` done inside the coprocess.
+static void adopt_cwd(const std::string& pwd){
+  std::error_code ec;
+  std::string prev = std::filesystem::current_path(ec).string();
+  if(pwd.empty() || pwd == prev) return;
+  std::filesystem::current_path(pwd, ec);
+  if(ec) return;
+  setenv("OLDPWD", prev.c_str(), 1);
+  setenv("PWD", pwd.c_str(), 1);
+  prompt_invalidate();
+}
+
+int coproc_run(const std::string& line){
+  std::lock_guard<std::mutex> lk(g_coproc_mu);
+  Coproc& c = g_coproc;
+  std::cout.flush();
+
+  for(int attempt = 0; attempt < 2; ++attempt){
+    if(c.pid < 0 && !coproc_start(c)){
+      coproc_stop(c);
+      return spawn_wait("/bin/sh", {"sh", "-c", line});
+    }
+
+    std::error_code ec;
+    std::string cwd = std::filesystem::current_path(ec).string();
+    std::string want = c.token + "_" + std::to_string(++c.seq);
+    std::string script;
+    if(!ec && cwd != c.cwd) script += "cd -- " + sh_quote(cwd) + "\n";   // REPL cd / chdir
+    script += "{ command eval " + sh_quote(line) + "\n} 0<&4 3>&- 4<&-; __pb_s=$?; "
+              "printf '%s %s %s\\n' " + want + " \"$__pb_s\" \"$PWD\" >&3\n";
+    if(!write_all(c.cmd_fd, script)){ coproc_stop(c); continue; }   // shell went away: restart
+
+    int status = 0; std::string pwd;
+    if(!coproc_wait(c, want, &status, &pwd)){
+      // `exit` (or a crash) ended the shell; the next line starts a new one
+      int code = coproc_stop(c);
+      return code < 0 ? 1 : code;
+    }
+    c.cwd = pwd;
+    adopt_cwd(pwd);
+    return status;
+  }
+  return 1;
+}
+
+// A stage naming something that is neither a program nor an in-process
+// stage may be a function or alias defined in the coprocess.
+static bool coproc_may_define(const std::vector<Stage>& stages, const InProcStages* inproc){
+  {
+    std::lock_guard<std::mutex> lk(g_coproc_mu);
+    if(g_coproc.pid < 0) return false;
+  }
+  for(const auto& st : stages){
+    if(inproc && inproc->handles && inproc->handles(st.argv[0])) continue;
+    if(command_hash_add(st.argv[0]).empty()) return true;
+  }
+  return false;
+}
+
+// `/bin/sh -c line` as a job of its own (with the terminal if `tty`, as in
+// launch_pipeline); stdout goes to `out_fd` (taken over) unless it is -1.
+static bool launch_shell(const std::string& line, bool group, bool tty, bool null_stdin, int out_fd, Job& job){
+  std::cout.flush();
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  if(null_stdin) posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+  if(out_fd >= 0) posix_spawn_file_actions_adddup2(&fa, out_fd, 1);
+  bool handoff = group && tty && add_terminal_handoff(&fa);
+  pid_t pid = -1;
+  int rc = spawn_child("/bin/sh", {"sh", "-c", line}, &fa, &pid, group ? 0 : -1);
+  posix_spawn_file_actions_destroy(&fa);
+  if(out_fd >= 0) ::close(out_fd);
+  if(rc != 0){
+    if(handoff) undo_terminal_handoff();
+    job.status = spawn_error_status("sh", rc);
+    return false;
+  }
+  job.pids = {pid};
+  job.last = pid;
+  job.pgid = group ? pid : -1;
+  job.cmd = line;
+  return true;
+}
+
+bool split_background(const std::string& line, std::string* rest){
+  size_t amp = std::string::npos;   // last unquoted '&' with only blanks after it
+  char q = 0;
+  for(size_t i=0;i<line.size();++i){
+    char c = line[i];
+    if(q){
+      if(c == '\\' && q == '"') ++i;
+      else if(c == q) q = 0;
+      amp = std::string::npos;
+      continue;
+    }
+    if(c == '\\'){ ++i; amp = std::string::npos; continue; }
+    if(c == '\'' || c == '"'){ q = c; amp = std::string::npos; continue; }
+    if(c == '&') amp = i;
+    else if(!std::isspace((unsigned char)c)) amp = std::string::npos;
+  }
+  if(q || amp == std::string::npos) return false;
+  if(amp > 0 && std::strchr("&|<>", line[amp-1])) return false;   // &&, |&, >&
+  std::string fg = trim(line.substr(0, amp));
+  if(fg.empty()) return false;
+  if(rest) *rest = std::move(fg);
+  return true;
+}
+
+// Background lines never use the coprocess: it runs one line at a time.
+static int run_background(const std::string& line, const InProcStages* inproc){
+  Job job;
+  std::vector<Stage> stages;
+  bool null_stdin = !g_job_control;   // nothing else would stop it reading ours
+  if(parse_pipeline(line, stages)){
+    for(const auto& st : stages){
+      if(inproc && inproc->handles && inproc->handles(st.argv[0])){
+        std::cerr << st.argv[0] << ": mods cannot run in the background\n";
+        return 1;
+      }
+    }
+    std::vector<int> status;
+    std::vector<std::thread> none;
+    if(!launch_pipeline(stages, nullptr, true, false, null_stdin, -1, job, status, none)) return 1;
+  } else if(!launch_shell(line, true, false, null_stdin, -1, job)){
+    return job.status;
+  }
+  if(job.pgid < 0) return job.status;   // no stage started
+  job.cmd = line;
+
+  std::lock_guard<std::mutex> lk(g_jobs_mu);
+  job.id = next_job_id_locked();
+  std::cout << "[" << job.id << "] " << (job.last > 0 ? job.last : job.pgid) << "\n";
+  g_jobs.push_back(std::move(job));
+  return 0;
+}
+
+int run_command_line(const std::string& line, const InProcStages* inproc,
+                     const std::vector<Stage>* parsed){
+  struct Listings { ~Listings(){ glob_cache_invalidate(); } } _listings;   // it may have changed any directory
+  std::vector<Stage> stages;
+  if(!parsed){
+    std::string bg;
+    if(split_background(line, &bg)) return run_background(bg, inproc);
+    if(!parse_pipeline(line, stages)){
+      if(coproc_enabled()) return coproc_run(line);
+      Job job;
+      if(!launch_shell(line, g_job_control, true, false, -1, job)) return job.status;
+      return foreground(std::move(job), true);
+    }
+    parsed = &stages;
+  }
+  if(coproc_enabled() && coproc_may_define(*parsed, inproc)) return coproc_run(line);
+  return run_pipeline(*parsed, inproc, line);
+}
+
+// ---- jobs, fg, bg, wait ---------------------------------------------------------
+
+// Index of the job `spec` names: %N or N (job number; a process id for
+// `wait`), %+ / %% / none for the current job, %- for the previous one.
+static int find_job_locked(const std::string& spec, bool pid_ok){
+  if(g_jobs.empty()) return -1;
+  int n = (int)g_jobs.size();
+  if(spec.empty() || spec == "%" || spec == "%%" || spec == "%+") return n - 1;
+  if(spec == "%-") return n >= 2 ? n - 2 : -1;
+  bool pct = spec[0] == '%';
+  std::string num = pct ? spec.substr(1) : spec;
+  if(!all_digits(num)) return -1;
+  long v = std::atol(num.c_str());
+  for(int i=0;i<n;++i){
+    const Job& j = g_jobs[(size_t)i];
+    if(pct || !pid_ok){
+      if(j.id == v) return i;
+    } else if(j.pgid == v || std::find(j.pids.begin(), j.pids.end(), (pid_t)v) != j.pids.end()){
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int builtin_jobs(const std::vector<std::string>& argv){
+  bool pids = argv.size() > 1 && argv[1] == "-p";
+  bool lng  = argv.size() > 1 && argv[1] == "-l";
+  std::lock_guard<std::mutex> lk(g_jobs_mu);
+  reap_jobs_locked();
+  for(size_t i=0;i<g_jobs.size();++i){
+    Job& j = g_jobs[i];
+    if(pids) std::cout << j.pgid << "\n";
+    else if(lng){
+      std::string l = job_line(j, job_mark_locked(i));
+      size_t sp = l.find(' ');
+      std::cout << l.substr(0, sp) << " " << j.pgid << l.substr(sp) << "\n";
+    }
+    else std::cout << job_line(j, job_mark_locked(i)) << "\n";
+    j.notify = false;
+  }
+  g_jobs.erase(std::remove_if(g_jobs.begin(), g_jobs.end(), [](const Job& j){ return j.state == Job::Done; }),
+               g_jobs.end());
+  return 0;
+}
+
+static int builtin_fg_bg(const std::vector<std::string>& argv){
+  const std::string& name = argv[0];
+  std::string spec = argv.size() > 1 ? argv[1] : "";
+  Job j;
+  {
+    std::lock_guard<std::mutex> lk(g_jobs_mu);
+    reap_jobs_locked();
+    int i = find_job_locked(spec, false);
+    if(i < 0){
+      std::cerr << name << ": " << (spec.empty() ? "current" : spec) << ": no such job\n";
+      return 1;
+    }
+    auto it = g_jobs.begin() + i;
+    if(name == "bg"){
+      if(it->state == Job::Running){
+        std::cerr << "bg: job " << it->id << " already in background\n";
+        return 0;
+      }
+      it->state = Job::Running;
+      it->notify = false;
+      kill(-it->pgid, SIGCONT);
+      std::rotate(it, it + 1, g_jobs.end());   // becomes the current job
+      std::cout << "[" << g_jobs.back().id << "]+ " << g_jobs.back().cmd << " &\n";
+      return 0;
+    }
+    j = std::move(*it);
+    g_jobs.erase(it);
+  }
+  std::cout << j.cmd << "\n";
+  if(j.state == Job::Done) return j.status;
+  j.state = Job::Running;
+  give_terminal(j);
+  kill(-j.pgid, SIGCONT);
+  return foreground(std::move(j), true);
+}
+
+static int builtin_wait(const std::vector<std::string>& argv){
+  std::vector<int> ids;
+  int rc = 0;
+  {
+    std::lock_guard<std::mutex> lk(g_jobs_mu);
+    if(argv.size() == 1){
+      for(const auto& j : g_jobs) if(j.state == Job::Running) ids.push_back(j.id);
+    }
+    for(size_t a=1;a<argv.size();++a){
+      int i = find_job_locked(argv[a], true);
+      if(i < 0){ std::cerr << "wait: " << argv[a] << ": no such job\n"; rc = 127; continue; }
+      ids.push_back(g_jobs[(size_t)i].id);
+    }
+  }
+  for(int id : ids){
+    Job j;
+    {
+      std::lock_guard<std::mutex> lk(g_jobs_mu);
+      auto it = std::find_if(g_jobs.begin(), g_jobs.end(), [id](const Job& x){ return x.id == id; });
+      if(it == g_jobs.end()) continue;
+      j = std::move(*it);
+      g_jobs.erase(it);
+    }
+    bool done = wait_job(j, false, true, false);
+    if(!done){
+      // Ctrl-C: stop waiting, keep the job
+      std::lock_guard<std::mutex> lk(g_jobs_mu);
+      g_jobs.push_back(std::move(j));
+      return 130;
+    }
+    rc = j.status;
+  }
+  return rc;
+}
+
+int job_command(const std::vector<std::string>& argv){
+  if(argv.empty()) return 1;
+  if(argv[0] == "jobs") return builtin_jobs(argv);
+  if(argv[0] == "fg" || argv[0] == "bg") return builtin_fg_bg(argv);
+  if(argv[0] == "wait") return builtin_wait(argv);
+  return 1;
+}
+
+// ---- reading a command's output -------------------------------------------------
+
+struct CommandReader::State {
+  std::vector<Stage> stages;     // in-process stages refer to these
+  InProcStages inproc;
+  Job job;
+  std::vector<int> status;
+  std::vector<std::thread> threads;
+  bool last_inproc{false};
+  int fd{-1};
+  std::unique_ptr<FdIStream> in;
+  int result{-1};
+};
+
+CommandReader::CommandReader(const std::string& line, const InProcStages* inproc) : st_(new State) {
+  int p[2];
+  if(pipe2(p, O_CLOEXEC) != 0){
+    std::cerr << "pipe: " << std::strerror(errno) << "\n";
+    st_->result = 1;
+    return;
+  }
+  State& s = *st_;
+  if(inproc) s.inproc = *inproc;
+  bool started;
+  if(parse_pipeline(line, s.stages)){
+    started = launch_pipeline(s.stages, inproc ? &s.inproc : nullptr, false, false, false, p[1],
+                              s.job, s.status, s.threads);
+    s.last_inproc = started && s.job.last < 0;
+  } else {
+    started = launch_shell(line, false, false, false, p[1], s.job);
+  }
+  if(!started){
+    ::close(p[0]);
+    s.result = s.job.status ? s.job.status : 1;
+    return;
+  }
+  s.fd = p[0];
+  s.in = std::make_unique<FdIStream>(s.fd);
+}
+
+CommandReader::~CommandReader(){ (void)close(); }
+
+bool CommandReader::ok() const { return st_->fd >= 0; }
+
+std::istream& CommandReader::in(){
+  static FdIStream none(-1);
+  return st_->in ? *st_->in : none;
+}
+
+size_t CommandReader::read(char* buf, size_t n){
+  if(st_->fd < 0) return 0;
+  ssize_t r;
+  do { r = ::read(st_->fd, buf, n); } while(r < 0 && errno == EINTR);
+  return r > 0 ? (size_t)r : 0;
+}
+
+int CommandReader::close(){
+  State& s = *st_;
+  if(s.fd < 0) return s.result;
+  // Closing first: a writer that is still going gets SIGPIPE (or EPIPE for a
+  // mod stage) rather than blocking on a full pipe.
+  s.in.reset();
+  ::close(s.fd);
+  s.fd = -1;
+  wait_job(s.job, false, false, false);
+  for(auto& t : s.threads) t.join();
+  glob_cache_invalidate();
+  s.result = s.last_inproc ? s.status.back() : s.job.status;
+  return s.result;
+}
+
+// ---- bounded parallel runs -------------------------------------------------------
+
+std::vector<int> run_parallel(const std::vector<std::string>& lines, size_t max_jobs,
+                              std::vector<std::string>* outputs, size_t out_cap,
+                              ParallelProgress* progress, const std::function<bool()>& cancelled){
+  const size_t n = lines.size();
+  std::vector<int> result(n, 128 + SIGINT);
+  if(outputs) outputs->assign(n, {});
+  ParallelProgress local;
+  ParallelProgress& pr = progress ? *progress : local;
+  pr.total = n; pr.started = 0; pr.done = 0; pr.failed = 0;
+  if(n == 0) return result;
+  std::cout.flush();
+
+  std::mutex mu;
+  std::condition_variable cv;
+  std::vector<pid_t> running(n, -1);   // process group of each started item
+  bool stop = false, finished = false;
+
+  auto run_one = [&](size_t i){
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      if(stop) return;
+    }
+    int p[2] = {-1, -1};
+    if(outputs && pipe2(p, O_CLOEXEC) != 0){
+      std::cerr << "pipe: " << std::strerror(errno) << "\n";
+      result[i] = 1;
+      ++pr.done; ++pr.failed;
+      return;
+    }
+    ++pr.started;
+    Job job;
+    std::vector<Stage> stages;
+    std::vector<int> status;
+    std::vector<std::thread> threads;   // stays empty: no in-process stages
+    bool started = parse_pipeline(lines[i], stages)
+      ? launch_pipeline(stages, nullptr, true, false, true, p[1], job, status, threads)
+      : launch_shell(lines[i], true, false, true, p[1], job);
+    if(started){
+      {
+        std::lock_guard<std::mutex> lk(mu);
+        running[i] = job.pgid;
+        if(stop && job.pgid > 0) kill(-job.pgid, SIGINT);   // cancelled while starting
+      }
+      if(outputs){
+        std::string& out = (*outputs)[i];
+        char buf[65536];
+        ssize_t r;
+        while((r = ::read(p[0], buf, sizeof buf)) != 0){
+          if(r < 0){ if(errno == EINTR) continue; break; }
+          if(out.size() < out_cap) out.append(buf, std::min((size_t)r, out_cap - out.size()));
+        }
+      }
+      wait_job(job, false, false, false);
+      std::lock_guard<std::mutex> lk(mu);
+      running[i] = -1;
+    }
+    if(p[0] >= 0) ::close(p[0]);
+    result[i] = started ? job.status : (job.status ? job.status : 1);
+    if(result[i] != 0) ++pr.failed;
+    ++pr.done;
+  };
+
+  // The workers block in read/waitpid; a watcher turns an interrupt into
+  // SIGINT for every running group.
+  std::thread watcher([&]{
+    std::unique_lock<std::mutex> lk(mu);
+    while(!finished){
+      cv.wait_for(lk, std::chrono::milliseconds(20));
+      if(finished || stop || !cancelled()) continue;
+      stop = true;
+      for(pid_t g : running) if(g > 0) kill(-g, SIGINT);
+    }
+  });
+  parallel_for(n, run_one, (unsigned)std::min<size_t>(max_jobs, std::numeric_limits<unsigned>::max()));
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    finished = true;
+  }
+  cv.notify_all();
+  watcher.join();
+  glob_cache_invalidate();
+  return result;
+}
+
+// ---- fd-backed runtime I/O ------------------------------------------------------
+
+void FdSink::write(const char* data, size_t n){
+  while(n && !broken){
+    ssize_t w = ::write(fd, data, n);
+    if(w < 0){
+      if(errno == EINTR) continue;
+      broken = true;   // EPIPE: downstream exited (SIGPIPE is ignored)
+      return;
+    }
+    data += w; n -= (size_t)w;
+  }
+}
+
+FdInBuf::int_type FdInBuf::underflow(){
+  if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  ssize_t r;
+  do { r = ::read(fd_, buf_, sizeof buf_); } while(r < 0 && errno == EINTR);
+  if(r <= 0) return traits_type::eof();
+  setg(buf_, buf_, buf_ + r);
+  return traits_type::to_int_type(*gptr());
+}
+
+void FdInBuf::release(){
+  off_t ahead = (off_t)(egptr() - gptr());
+  if(ahead > 0 && ::lseek(fd_, -ahead, SEEK_CUR) >= 0) setg(buf_, buf_, buf_);
+}
+
+#else  // _WIN32: no posix_spawn; keep the system() passthrough
+
+std::string resolve_program(const std::string& name){ return name; }
+std::vector<HashedCommand> command_hash_list(){ return {}; }
+std::string command_hash_add(const std::string& name){ return name; }
+bool command_hash_forget(const std::string&){ return false; }
+void command_hash_clear(){}
+std::vector<std::string> path_commands(const std::string&){ return {}; }
+int wait_status_code(int status){ return status; }
+int spawn_wait(const std::string& path, const std::vector<std::string>& argv){
+  std::string cmd = "\"" + path + "\"";
+  for(size_t i=1;i<argv.size();++i) cmd += " \"" + argv[i] + "\"";
+  return std::system(cmd.c_str());
+}
+int run_pipeline(const std::vector<Stage>&, const InProcStages*, const std::string&){ return 1; }
+int run_command_line(const std::string& line, const InProcStages*, const std::vector<Stage>*){
+  return std::system(line.c_str());
+}
+bool split_background(const std::string&, std::string*){ return false; }
+void jobs_init(){}
+void jobs_notify(){}
+void jobs_shutdown(){}
+int job_command(const std::vector<std::string>& argv){
+  std::cerr << (argv.empty() ? "jobs" : argv[0]) << ": job control is not supported on this platform\n";
+  return 1;
+}
+struct CommandReader::State { FdIStream in{-1}; };
+CommandReader::CommandReader(const std::string&, const InProcStages*) : st_(new State) {}
+CommandReader::~CommandReader() = default;
+bool CommandReader::ok() const { return false; }
+std::istream& CommandReader::in(){ return st_->in; }
+size_t CommandReader::read(char*, size_t){ return 0; }
+int CommandReader::close(){ return 1; }
+std::vector<int> run_parallel(const std::vector<std::string>& lines, size_t, std::vector<std::string>* outputs,
+                              size_t, ParallelProgress* progress, const std::function<bool()>&){
+  std::vector<int> result;
+  for(const auto& line : lines) result.push_back(std::system(line.c_str()));
+  if(outputs) outputs->assign(lines.size(), {});
+  if(progress){
+    progress->total = progress->started = progress->done = lines.size();
+    progress->failed = (size_t)std::count_if(result.begin(), result.end(), [](int s){ return s != 0; });
+  }
+  return result;
+}
+bool coproc_enabled(){ return false; }
+int coproc_run(const std::string& line){ return std::system(line.c_str()); }
+void FdSink::write(const char*, size_t){}
+FdInBuf::int_type FdInBuf::underflow(){ return traits_type::eof(); }
+void FdInBuf::release(){}
+
+#endif
+
+// ---- background parallel batches ------------------------------------------------
+
+ParallelBatch::ParallelBatch(std::vector<std::string> lines, size_t max_jobs, bool capture, size_t out_cap)
+  : lines_(std::move(lines)) {
+  progress_.total = lines_.size();
+  thread_ = std::thread([this, max_jobs, capture, out_cap]{
+    status_ = run_parallel(lines_, max_jobs, capture ? &outputs_ : nullptr, out_cap, &progress_,
+                           [this]{ return cancel_.load(std::memory_order_relaxed); });
+    done_.store(true, std::memory_order_release);
+  });
+}
+
+ParallelBatch::~ParallelBatch(){
+  if(joined_) return;
+  cancel();
+  thread_.join();
+}
+
+const std::vector<int>& ParallelBatch::wait(const std::function<bool()>& cancelled){
+  if(!joined_){
+    while(!done_.load(std::memory_order_acquire)){
+      if(cancelled && cancelled()) cancel();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    thread_.join();
+    joined_ = true;
+  }
+  return status_;
+}
+
+} // namespace pb
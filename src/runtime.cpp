@@ -1,6 +1,12 @@
 #include "prismshell/runtime.hpp"
+#include "prismshell/fileio.hpp"
+#include "prismshell/glob.hpp"
+#include "prismshell/mods.hpp"
 #include "prismshell/parser.hpp"
 #include "prismshell/lexer.hpp"
+#include "prismshell/parse_cache.hpp"
+#include "prismshell/plugins.hpp"
+#include "prismshell/process.hpp"
 #include "prismshell/utils.hpp"
 
 #include <iostream>
@@ -10,8 +16,12 @@
 #include <system_error>
 #include <cstdlib>
 #include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <limits>
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
 #include <ctime>
 #include <random>
@@ -20,13 +30,15 @@
 
 #ifndef _WIN32
   #include <unistd.h>
-  #include <glob.h>
 #else
   #include <windows.h>
 #endif
 #include <algorithm>
 #include <atomic>
 #include <csignal>
+#include <mutex>
+#include <optional>
+#include <streambuf>
 
 namespace fs = std::filesystem;
 
@@ -63,6 +75,9 @@ namespace {
   };
 
   inline bool rt_interrupted(){ return g_rt_sigint.load(std::memory_order_relaxed); }
+  inline bool rt_interrupted(const Runtime& rt){
+    return rt_interrupted() || (rt.cancel && rt.cancel->load(std::memory_order_relaxed));
+  }
 }
 
 
@@ -73,35 +88,248 @@ static Value str(std::string s)         { return Value{std::move(s)}; }
 
 /* ---------------- Mod registry (in-memory) ---------------- */
 
+// Warm runtime kept between invocations of one mod. Only used by one caller
+// at a time; nested or concurrent runs of the same mod get a fresh Runtime.
+struct ModResident {
+  std::mutex busy;
+  Runtime rt;
+};
+
 struct ModEntry {
   std::string name;
-  std::map<int,std::string> program; // the mod's BASIC program listing
+  std::shared_ptr<const std::map<int,std::string>> program; // immutable listing, shared with runs
   int entry{0};                      // entry line to start from
+  std::string source;                // file it came from; program is loaded lazily when null
+  std::shared_ptr<const ProgramImage> image;   // compiled on first run
+  std::shared_ptr<ModResident> resident{std::make_shared<ModResident>()};
 };
 
 static std::unordered_map<std::string, ModEntry> g_mods;
+static std::mutex g_mods_mu;  // mods may run off the REPL thread (async prompt)
+static std::atomic<unsigned> g_mods_gen{1};  // bumped when names are added or removed
+
+unsigned mod_generation(){ return g_mods_gen.load(std::memory_order_acquire); }
 
 static void mod_register_from_rt(Runtime& rt, const std::string& name, int entry) {
   ModEntry m;
   m.name   = name;
-  m.program= rt.program;  // capture the mod's program as authored
+  // capture the mod's program as authored (once, at registration)
+  m.program= rt.shared_program ? rt.shared_program
+                               : std::make_shared<const std::map<int,std::string>>(rt.program);
   m.entry  = entry;
-  g_mods[name] = std::move(m);
+  if(rt.mod_sink){
+    rt.mod_sink->push_back(ModRegistration{name, entry, m.program, {}});
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(g_mods_mu);
+    g_mods[name] = std::move(m);
+  }
+  g_mods_gen.fetch_add(1, std::memory_order_release);
+  prompt_invalidate();
+}
+
+void mod_apply(const std::vector<ModRegistration>& regs, const std::vector<std::string>& drop) {
+  if(regs.empty() && drop.empty()) return;
+  {
+    std::lock_guard<std::mutex> lk(g_mods_mu);
+    for(const auto& name : drop) g_mods.erase(name);
+    for(const auto& r : regs){
+      ModEntry m;
+      m.name = r.name; m.program = r.program; m.entry = r.entry; m.source = r.source;
+      g_mods[r.name] = std::move(m);
+    }
+  }
+  g_mods_gen.fetch_add(1, std::memory_order_release);
+  prompt_invalidate();
+}
+
+/* ---------------- Mod profiling ---------------- */
+
+struct ModStats {
+  uint64_t calls{0}, errors{0};
+  uint64_t total_ns{0}, max_ns{0};
+  uint64_t stmts{0}, builtins{0}, bytes{0};
+  std::vector<uint64_t> recent;   // ring of the last kStatSamples wall times (ns), for p99
+  size_t next{0};
+};
+static constexpr size_t kStatSamples = 1024;
+
+static std::map<std::string, ModStats> g_mod_stats;  // by command name; survives reloads
+static std::mutex g_stats_mu;
+
+static void mod_stats_exit_dump(){
+  if(const char* p = std::getenv("PRISMSHELL_MOD_STATS"))
+    if(*p && !mod_stats_dump(p)) std::cerr << "mod stats: cannot write " << p << "\n";
+}
+
+static void mod_stats_record(const std::string& name, uint64_t ns, const ExecCounters& c, bool failed){
+  static std::once_flag exit_hook;
+  std::call_once(exit_hook, []{ if(std::getenv("PRISMSHELL_MOD_STATS")) std::atexit(mod_stats_exit_dump); });
+
+  std::lock_guard<std::mutex> lk(g_stats_mu);
+  ModStats& st = g_mod_stats[name];
+  ++st.calls;
+  if(failed) ++st.errors;
+  st.total_ns += ns;
+  st.max_ns    = std::max(st.max_ns, ns);
+  st.stmts    += c.stmts;
+  st.builtins += c.builtins;
+  st.bytes    += c.bytes;
+  if(st.recent.size() < kStatSamples) st.recent.push_back(ns);
+  else { st.recent[st.next] = ns; st.next = (st.next + 1) % kStatSamples; }
+}
+
+std::string mod_stats_table(bool tsv){
+  static const char* const kCols[] = {
+    "mod", "calls", "errors", "total_ms", "mean_ms", "p99_ms", "max_ms", "stmts", "builtins", "bytes",
+  };
+  std::vector<std::vector<std::string>> rows;
+  rows.emplace_back(std::begin(kCols), std::end(kCols));
+  {
+    std::lock_guard<std::mutex> lk(g_stats_mu);
+    for(const auto& kv : g_mod_stats){
+      const ModStats& st = kv.second;
+      std::vector<uint64_t> v = st.recent;
+      uint64_t p99 = 0;
+      if(!v.empty()){
+        size_t k = (v.size() * 99 + 99) / 100 - 1;   // nearest-rank
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        p99 = v[k];
+      }
+      auto ms = [](double ns){ std::ostringstream os; os << std::fixed << std::setprecision(3) << ns / 1e6; return os.str(); };
+      rows.push_back({ kv.first, std::to_string(st.calls), std::to_string(st.errors),
+                       ms((double)st.total_ns), ms(st.calls ? (double)st.total_ns / (double)st.calls : 0.0),
+                       ms((double)p99), ms((double)st.max_ns),
+                       std::to_string(st.stmts), std::to_string(st.builtins), std::to_string(st.bytes) });
+    }
+  }
+
+  std::vector<size_t> width(rows[0].size(), 0);
+  for(const auto& r : rows) for(size_t i=0;i<r.size();++i) width[i] = std::max(width[i], r[i].size());
+  std::string out;
+  for(const auto& r : rows){
+    for(size_t i=0;i<r.size();++i){
+      if(tsv){ if(i) out += '\t'; out += r[i]; continue; }
+      if(i) out += "  ";
+      std::string pad(width[i] - r[i].size(), ' ');
+      out += (i == 0) ? r[i] + pad : pad + r[i];   // names left, numbers right
+    }
+    out += '\n';
+  }
+  return out;
+}
+
+void mod_stats_reset(){
+  std::lock_guard<std::mutex> lk(g_stats_mu);
+  g_mod_stats.clear();
+}
+
+bool mod_stats_dump(const std::string& path){
+  std::string host = "localhost";
+#ifndef _WIN32
+  char hb[256] = {0};
+  if(gethostname(hb, sizeof hb - 1) == 0 && hb[0]) host = hb;
+  std::string pid = std::to_string((long)getpid());
+#else
+  std::string pid = std::to_string((long)GetCurrentProcessId());
+#endif
+  std::string p;
+  for(size_t i=0;i<path.size();++i){
+    if(path[i]=='%' && i+1<path.size() && path[i+1]=='h'){ p += host; ++i; }
+    else if(path[i]=='%' && i+1<path.size() && path[i+1]=='p'){ p += pid; ++i; }
+    else p += path[i];
+  }
+
+  // Write-then-rename so collectors never pick up a half-written file
+  std::string tmp = p + ".tmp" + pid;
+  {
+    std::ofstream f(tmp, std::ios::trunc);
+    if(!f) return false;
+    f << "# prismshell mod stats host=" << host << " pid=" << pid
+      << " time=" << (long long)std::time(nullptr) << "\n"
+      << mod_stats_table(true);
+    if(!f) return false;
+  }
+  std::error_code ec;
+  fs::rename(tmp, p, ec);
+  if(ec){ fs::remove(tmp, ec); return false; }
+  return true;
 }
 
 bool mod_has(const std::string& name) {
+  std::lock_guard<std::mutex> lk(g_mods_mu);
   return g_mods.find(name) != g_mods.end();
 }
 
 // Run a mod and capture a resulting string (PROMPT or lastCall string).
-int mod_run_capture(const std::string& name, const std::vector<std::string>& args, Runtime& parent, std::string* out) {
-  auto it = g_mods.find(name);
-  if (it == g_mods.end()) return 127; // not found
-  const ModEntry& m = it->second;
+static int mod_invoke(const std::string& name, const std::vector<std::string>& args, Runtime& parent,
+                      std::string* out, OutputSink* sink, std::istream* in) {
+  ModEntry m;
+  {
+    std::lock_guard<std::mutex> lk(g_mods_mu);
+    auto it = g_mods.find(name);
+    if (it == g_mods.end()) return 127; // not found
+    m = it->second;                     // cheap: the listing is shared
+  }
+
+  // Profile every invocation that reached the registry (load failures count as errors)
+  auto t0 = std::chrono::steady_clock::now();
+  ExecCounters work;
+  bool failed = true;
+  struct Record {
+    const std::string& name; std::chrono::steady_clock::time_point t0; ExecCounters& work; bool& failed;
+    ~Record(){
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+      mod_stats_record(name, (uint64_t)ns, work, failed);
+    }
+  } _record{name, t0, work, failed};
+
+  // Manifest stub: parse the mod file on first use and share it with every
+  // command registered from the same file.
+  if (!m.program) {
+    auto prog = std::make_shared<std::map<int,std::string>>();
+    if (m.source.empty() || !read_mod_program(m.source, *prog)) {
+      std::cerr << "Mod '"<<name<<"' could not be loaded from " << m.source << "\n";
+      return 1;
+    }
+    m.program = prog;
+    std::lock_guard<std::mutex> lk(g_mods_mu);
+    for (auto& kv : g_mods)
+      if (!kv.second.program && kv.second.source == m.source) kv.second.program = m.program;
+  }
+
+  // Compile once; every later invocation is dispatch-bound, not parse-bound.
+  if (!m.image) {
+    m.image = ProgramImage::compile(*m.program);
+    std::lock_guard<std::mutex> lk(g_mods_mu);
+    for (auto& kv : g_mods)
+      if (!kv.second.image && kv.second.program == m.program) kv.second.image = m.image;
+  }
 
-  Runtime child;
-  child.program = m.program;     // run the mod's program
-  child.vars    = parent.vars;   // inherit variables/env
+  // Reuse the mod's warm runtime unless it is already running (recursion,
+  // async prompt render); only its own variable layer is reset per call.
+  std::unique_lock<std::mutex> warm(m.resident->busy, std::try_to_lock);
+  std::optional<Runtime> fresh;
+  Runtime& child = warm.owns_lock() ? m.resident->rt : fresh.emplace();
+  child.vars.clear();
+  child.readers.clear();             // Shell.Lines left open by the last call
+  child.batches.clear();             // cancels Shell.Start batches never waited for
+  child.parallel_out.clear();
+  child.files.clear();               // FS.Open handles likewise
+  child.walks.clear();
+  child.writers.clear();
+  child.lastCall       = Value{};
+  child.shared_program = m.program;  // run the mod's program (shared, not copied)
+  child.image          = m.image;
+  child.scope_parent   = &parent;    // inherit variables through a read-only overlay
+  child.trap_sigint    = parent.trap_sigint;
+  child.cancel         = parent.cancel;
+  child.restricted     = parent.restricted;
+  child.counters       = ExecCounters{};
+  child.sink           = sink ? sink : parent.sink;   // nested mods print where the caller prints
+  child.input          = in ? in : parent.input;
+  struct Detach { Runtime& rt; ~Detach(){ rt.scope_parent = nullptr; } } _detach{child};
 
   // Populate arg variables for the mod
   std::ostringstream all;
@@ -116,26 +344,150 @@ int mod_run_capture(const std::string& name, const std::vector<std::string>& arg
   child.vars["PB_ARGV"] = all.str();  // space-joined for now
 
   auto res = child.run_program(m.entry);
+  work = child.counters;
+  if (!child.sink && stdout_is_tty()) stdout_flush();   // a partial line it left on the terminal
   if (res.err) {
-    std::cerr << "Mod '"<<name<<"' error at " << res.err->line << ": " << res.err->msg << "\n";
+    // A render stopped through `cancel` was abandoned on purpose: no report.
+    if (!(child.cancel && child.cancel->load(std::memory_order_relaxed)))
+      std::cerr << "Mod '"<<name<<"' error at " << res.err->line << ": " << res.err->msg << "\n";
     return 1;
   }
 
   if (out) {
     // Prefer PROMPT var if set, else child's lastCall, else empty
-    auto itp = child.vars.find("PROMPT");
-    if (itp != child.vars.end()) *out = to_string(itp->second);
-    else                         *out = to_string(child.lastCall);
+    if (const Value* pv = child.lookup("PROMPT")) *out = to_string(*pv);
+    else                                          *out = to_string(child.lastCall);
   }
+  failed = false;
   return 0;
 }
 
+int mod_run_capture(const std::string& name, const std::vector<std::string>& args, Runtime& parent, std::string* out) {
+  return mod_invoke(name, args, parent, out, nullptr, nullptr);
+}
+
+int mod_run_io(const std::string& name, const std::vector<std::string>& args, Runtime& parent,
+               OutputSink* sink, std::istream* in) {
+  return mod_invoke(name, args, parent, nullptr, sink, in);
+}
+
 // Backwards-compatible wrapper used by command mods (no capture needed).
 int mod_run(const std::string& name, const std::vector<std::string>& args, Runtime& parent) {
   std::string ignored;
   return mod_run_capture(name, args, parent, &ignored);
 }
 
+/* ---------------- Prompt invalidation ---------------- */
+
+static std::atomic<unsigned long> g_prompt_epoch{0};
+
+unsigned long prompt_epoch(){ return g_prompt_epoch.load(std::memory_order_relaxed); }
+void prompt_invalidate(){ g_prompt_epoch.fetch_add(1, std::memory_order_relaxed); }
+
+/* ---------------- Runtime: variable scopes ---------------- */
+
+const Value* Runtime::lookup(const std::string& name) const {
+  for(const Runtime* r = this; r; r = r->scope_parent){
+    auto it = r->vars.find(name);
+    if(it != r->vars.end()) return &it->second;
+  }
+  return nullptr;
+}
+
+/* ---------------- Runtime: I/O ---------------- */
+
+namespace {
+// Also std::cout's streambuf. No put area: every write takes the lock, since
+// mod stages and the prompt renderer print from other threads.
+class StdoutBuffer : public std::streambuf, public OutputSink {
+public:
+  StdoutBuffer(){
+#ifndef _WIN32
+    tty_ = isatty(STDOUT_FILENO) == 1;
+#endif
+    buf_.reserve(tty_ ? 4096 : kBlock);
+  }
+  bool tty() const { return tty_; }
+
+  void write(const char* data, size_t n) override {
+    std::lock_guard<std::mutex> lk(mu_);
+    if(tty_){
+      buf_.append(data, n);
+      if(std::memchr(data, '\n', n)) drain();
+      return;
+    }
+    if(buf_.size() + n > kBlock){
+      drain();
+      if(n >= kBlock){ put(data, n); return; }
+    }
+    buf_.append(data, n);
+  }
+  void flush(){
+    std::lock_guard<std::mutex> lk(mu_);
+    drain();
+  }
+
+protected:
+  std::streamsize xsputn(const char* s, std::streamsize n) override { write(s, (size_t)n); return n; }
+  int_type overflow(int_type c) override {
+    if(!traits_type::eq_int_type(c, traits_type::eof())){ char ch = (char)c; write(&ch, 1); }
+    return traits_type::not_eof(c);
+  }
+  int sync() override { flush(); return 0; }
+
+private:
+  static constexpr size_t kBlock = size_t(64) << 10;
+
+  void drain(){ put(buf_.data(), buf_.size()); buf_.clear(); }
+  void put(const char* data, size_t n){
+#ifndef _WIN32
+    while(n){
+      ssize_t w = ::write(STDOUT_FILENO, data, n);
+      if(w < 0){
+        if(errno == EINTR) continue;
+        return;   // EPIPE and friends: the output is gone either way
+      }
+      data += w; n -= (size_t)w;
+    }
+#else
+    std::fwrite(data, 1, n, stdout);
+    std::fflush(stdout);
+#endif
+  }
+
+  std::mutex mu_;
+  std::string buf_;
+  bool tty_{false};
+};
+
+StdoutBuffer& stdout_buffer(){
+  // Never destroyed: std::cout is flushed into it during exit
+  static StdoutBuffer* b = []{
+    std::cout.flush();
+    std::fflush(stdout);
+    auto* sb = new StdoutBuffer;
+    std::cout.rdbuf(sb);
+    return sb;
+  }();
+  return *b;
+}
+}
+
+OutputSink& stdout_sink(){ return stdout_buffer(); }
+void stdout_flush(){ stdout_buffer().flush(); }
+bool stdout_is_tty(){ return stdout_buffer().tty(); }
+
+void Runtime::write_out(const std::string& s){
+  counters.bytes += s.size();
+  (sink ? *sink : stdout_sink()).write(s.data(), s.size());
+}
+
+bool Runtime::read_line(std::string& line){
+  line.clear();
+  if(!input) stdout_flush();   // the prompt or partial line the user is answering
+  return (bool)std::getline(input ? *input : std::cin, line);
+}
+
 /* ---------------- Runtime: expression eval ---------------- */
 
 Value Runtime::eval(const ExprPtr& e){
@@ -146,13 +498,15 @@ Value Runtime::eval(const ExprPtr& e){
 
     case Expr::Var: {
       if(e->name == "_") return lastCall;
-      auto it = vars.find(e->name);
-      return it == vars.end() ? Value{} : it->second;
+      const Value* v = lookup(e->name);
+      return v ? *v : Value{};
     }
 
     case Expr::CallFn: {
+      ++counters.builtins;
       std::vector<Value> args; args.reserve(e->args.size());
       for(const auto& a : e->args) args.push_back(eval(a));
+      if(const PluginFn* pf = plugin_bind(e->bind, e->name)) return plugin_call(*pf, args);
       return call_dispatch(*this, e->name, args);
     }
 
@@ -196,7 +550,9 @@ Value Runtime::eval(const ExprPtr& e){
 
 Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
   Result r;
-  if (rt_interrupted()) { return Result{ Error{ s ? s->line : 0, "Interrupted (Ctrl-C)" } }; }
+  const auto& program = code();  // own listing, or the mod's shared one
+  if (rt_interrupted(*this)) { return Result{ Error{ s ? s->line : 0, "Interrupted (Ctrl-C)" } }; }
+  ++counters.stmts;
 
   switch(s->kind){
     case Stmt::Rem: break;
@@ -206,14 +562,18 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
     } break;
 
     case Stmt::Print: {
-      auto v = eval(s->printExpr);
-      std::cout << to_string(v);
-      if(s->printNewline) std::cout << "\n";
+      std::string text = to_string(eval(s->printExpr));
+      if(s->printNewline) text += "\n";
+      write_out(text);
     } break;
 
     case Stmt::Input: {
-      std::cout << s->inputVar << "? ";
-      std::string line; std::getline(std::cin, line);
+      if(!input){
+        std::string prompt = s->inputVar + "? ";   // on the terminal even when output is piped
+        counters.bytes += prompt.size();
+        stdout_sink().write(prompt.data(), prompt.size());
+      }
+      std::string line; read_line(line);
       vars[s->inputVar] = line;
     } break;
 
@@ -231,7 +591,7 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
 
         for(auto it = program.upper_bound(cur); it != program.end(); ++it){
           int ln = it->first;
-          std::string kw = first_kw(it->second, ln);
+          std::string kw = line_kw(ln, it->second);
 
           if(kw == "IF"){ ++depth; continue; }      // nested IF
           if(kw == "ENDIF"){
@@ -242,10 +602,9 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
           if(depth > 0) continue;                   // still inside nested IF, ignore
 
           if(kw == "ELSEIF"){
-            // Evaluate this ELSEIF's condition: lex/parse just this line
-            Lexer lx(it->second, ln);
-            Parser p(lx.lex());
-            auto po = p.parse();
+            // Evaluate this ELSEIF's condition (parsed form of just this line)
+            ParsedLine pl = line_parsed(ln, it->second);
+            const ParseOut& po = *pl;
             if(!po.err && !po.stmts.empty()){
               auto he = po.stmts.front(); // ElseIfThen
               if(truthy(eval(he->ifCond))){
@@ -273,7 +632,7 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
       int jump = std::numeric_limits<int>::max();
       for(auto it = program.upper_bound(cur); it != program.end(); ++it){
         int ln = it->first;
-        std::string kw = first_kw(it->second, ln);
+        std::string kw = line_kw(ln, it->second);
         if(kw == "IF"){ ++depth; continue; }
         if(kw == "ENDIF"){
           if(depth == 0){ jump = next_line_after(program, ln); break; }
@@ -289,7 +648,7 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
       int jump = std::numeric_limits<int>::max();
       for(auto it = program.upper_bound(cur); it != program.end(); ++it){
         int ln = it->first;
-        std::string kw = first_kw(it->second, ln);
+        std::string kw = line_kw(ln, it->second);
         if(kw == "IF"){ ++depth; continue; }
         if(kw == "ENDIF"){
           if(depth == 0){ jump = next_line_after(program, ln); break; }
@@ -322,9 +681,11 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
     } break;
 
     case Stmt::Call: {
+      ++counters.builtins;
       std::vector<Value> args; args.reserve(s->callArgs.size());
       for(const auto& a : s->callArgs) args.push_back(eval(a));
-      lastCall = call_dispatch(*this, s->callName, args);
+      if(const PluginFn* pf = plugin_bind(s->callBind, s->callName)) lastCall = plugin_call(*pf, args);
+      else lastCall = call_dispatch(*this, s->callName, args);
       vars["_"] = lastCall;
     } break;
 
@@ -337,8 +698,8 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
         for(auto it = program.upper_bound(cur); it != program.end(); ++it){
           int ln = it->first;
           const std::string& src = it->second;
-          if(first_token_is_id_kw(src, ln, "WHILE")) { ++depth; continue; }
-          if(first_token_is_id_kw(src, ln, "WEND")){
+          if(line_kw(ln, src) == "WHILE") { ++depth; continue; }
+          if(line_kw(ln, src) == "WEND"){
             if(depth == 0){
               auto it2 = program.upper_bound(ln);
               target = (it2 == program.end()) ? std::numeric_limits<int>::max() : it2->first;
@@ -362,8 +723,8 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
         --it;
         int ln = it->first;
         const std::string& src = it->second;
-        if(first_token_is_id_kw(src, ln, "WEND")) { ++depth; continue; }
-        if(first_token_is_id_kw(src, ln, "WHILE")){
+        if(line_kw(ln, src) == "WEND") { ++depth; continue; }
+        if(line_kw(ln, src) == "WHILE"){
           if(depth == 0){ target = ln; break; }
           else { --depth; }
         }
@@ -383,16 +744,15 @@ Result Runtime::exec(const StmtPtr& s, int* pc, std::vector<int>& gosubStack){
 
 Result Runtime::run_line_direct(const std::string& line, int lineNo){
   Result r;
-  Lexer lx(line, lineNo);
-  Parser p(lx.lex());
-  auto out = p.parse();
-  if(out.err){ r.err = out.err; return r; }
+  // Repeated lines (history recalls, internal CALLs, shell commands that
+  // fail to parse) skip the lexer/parser via the LRU cache.
+  ParsedLine out = direct_parse_cache().get(line, lineNo);
+  if(out->err){ r.err = out->err; return r; }
 
   int pc = lineNo;
   std::vector<int> gs;
-  for(const auto& st : out.stmts){
-          if (rt_interrupted()) { r.err = Error{ lineNo, "Interrupted (Ctrl-C)" }; break; }
-    if (rt_interrupted()) { r.err = Error{ lineNo, "Interrupted (Ctrl-C)" }; break; }
+  for(const auto& st : out->stmts){
+    if (rt_interrupted(*this)) { r.err = Error{ lineNo, "Interrupted (Ctrl-C)" }; break; }
     auto rr = exec(st, &pc, gs);
     if(rr.err){ r.err = rr.err; break; }
   }
@@ -405,43 +765,41 @@ Result Runtime::run_program(){
 
 Result Runtime::run_program(int startLine){
   Result r;
-  RtSigintScope _rt_sig_scope;  // enable Ctrl-C -> interrupt during program run
-
-  if(program.empty()) return r;
-
-  std::vector<int> lines; lines.reserve(program.size());
-  for(auto& kv : program) lines.push_back(kv.first);
-  std::sort(lines.begin(), lines.end());
-
-  std::map<int,int> idx; for(size_t k=0;k<lines.size();++k) idx[lines[k]] = (int)k;
-
-  int i = 0;
-  if(startLine >= 0) {
-    auto it = idx.lower_bound(startLine);
-    i = (it==idx.end()) ? (int)lines.size() : it->second;
-  }
+  std::optional<RtSigintScope> _rt_sig_scope;  // enable Ctrl-C -> interrupt during program run
+  if(trap_sigint) _rt_sig_scope.emplace();
+
+  // Mods arrive pre-compiled; otherwise compile once for this run so loops
+  // don't re-lex/parse their lines on every iteration.
+  std::shared_ptr<const ProgramImage> img = image ? image : ProgramImage::compile(code());
+  const auto& lines = img->lines;
+  if(lines.empty()) return r;
+
+  struct ActiveScope {
+    Runtime* rt; const ProgramImage* prev;
+    ~ActiveScope(){
+      rt->active_image = prev;
+      for(auto& w : rt->writers) (void)w.second->flush();   // ended, errored or interrupted
+    }
+  } _active{this, active_image};
+  active_image = img.get();
+  GlobCacheScope _globs;   // directory listings are reused until the run ends
 
+  size_t i = (startLine >= 0) ? img->index_of(startLine) : 0;
   std::vector<int> gosubStack;
 
-  while(i >= 0 && i < (int)lines.size()){
-    if (rt_interrupted()) { r.err = Error{ lines[i], "Interrupted (Ctrl-C)" }; break; }
+  while(i < lines.size()){
+    if (rt_interrupted(*this)) { r.err = Error{ lines[i], "Interrupted (Ctrl-C)" }; break; }
     int lineNo = lines[i];
-    std::string src = program[lineNo];
-
-    Lexer lx(src, lineNo);
-    Parser p(lx.lex());
-    auto out = p.parse();
+    const ParseOut& out = *img->parsed[i];
     if(out.err){ r.err = out.err; break; }
 
     int pc = lineNo;
     for(const auto& st : out.stmts){
       auto rr = exec(st, &pc, gosubStack);
-      if(rr.err){ r.err = rr.err; i = (int)lines.size(); break; }
+      if(rr.err){ r.err = rr.err; i = lines.size(); break; }
 
       if(pc != lineNo){
-        auto it = idx.lower_bound(pc);
-        if(it == idx.end() || it->first != pc) i = it == idx.end() ? (int)lines.size() : it->second;
-        else i = it->second;
+        i = img->index_of(pc);
         goto next_iter;
       }
     }
@@ -449,15 +807,65 @@ Result Runtime::run_program(int startLine){
     next_iter: ;
   }
 
+  // Ctrl-C also cancels the Shell.Start batches still running
+  if (rt_interrupted(*this)) for (auto& b : batches) b.second->cancel();
   return r;
 }
 
+/* ---------------- Program images ---------------- */
+
+std::shared_ptr<const ProgramImage> ProgramImage::compile(const std::map<int,std::string>& program){
+  auto img = std::make_shared<ProgramImage>();
+  img->lines.reserve(program.size());
+  img->parsed.reserve(program.size());
+  img->kw.reserve(program.size());
+  for(const auto& [ln, src] : program){   // std::map: already sorted
+    Lexer lx(src, ln);
+    auto toks = lx.lex();
+    std::string kw;
+    if(!toks.empty() && toks[0].k == TokKind::Id){
+      kw = toks[0].text;
+      for(char& c : kw) c = (char)std::toupper((unsigned char)c);
+    }
+    Parser p(std::move(toks));
+    img->lines.push_back(ln);
+    img->parsed.push_back(std::make_shared<const ParseOut>(p.parse()));
+    img->kw.push_back(std::move(kw));
+  }
+  return img;
+}
+
+size_t ProgramImage::index_of(int line) const {
+  return (size_t)(std::lower_bound(lines.begin(), lines.end(), line) - lines.begin());
+}
+
+std::string Runtime::line_kw(int line, const std::string& src) const {
+  if(active_image){
+    size_t k = active_image->index_of(line);
+    if(k < active_image->lines.size() && active_image->lines[k] == line) return active_image->kw[k];
+  }
+  return first_kw(src, line);
+}
+
+ParsedLine Runtime::line_parsed(int line, const std::string& src) const {
+  if(active_image){
+    size_t k = active_image->index_of(line);
+    if(k < active_image->lines.size() && active_image->lines[k] == line) return active_image->parsed[k];
+  }
+  return direct_parse_cache().get(src, line);
+}
+
 /* ---------------- Runtime: editor helpers ---------------- */
 
 void Runtime::list(){
+  std::string text;
   for(const auto& kv : program){
-    std::cout << kv.first << " " << kv.second << "\n";
+    text += std::to_string(kv.first);
+    text += ' ';
+    text += kv.second;
+    text += '\n';
   }
+  stdout_sink().write(text.data(), text.size());
 }
 
 bool Runtime::save(const std::string& path){
@@ -562,27 +970,75 @@ bool Runtime::load(const std::string& path){
 
 /* ---------------- Runtime: shell passthrough ---------------- */
 
-int Runtime::sh_exec(const std::string& line){
-#ifndef _WIN32
-  std::string cmd = std::string("/bin/sh -lc \"") + line + "\"";
-  return std::system(cmd.c_str());
-#else
-  return std::system(line.c_str());
-#endif
+// Mods (those `mod_stage` accepts, or every registered one) as in-process
+// pipeline stages: they run on worker threads over the pipe fds.
+static InProcStages mod_stages(Runtime& rt, const std::function<bool(const std::string&)>& mod_stage){
+  InProcStages mods;
+  mods.handles = mod_stage ? mod_stage : [](const std::string& cmd){ return mod_has(cmd); };
+  mods.run = [&rt](const std::vector<std::string>& argv, int in_fd, int out_fd){
+    FdSink sink(out_fd);
+    FdIStream in(in_fd);
+    std::vector<std::string> args(argv.begin()+1, argv.end());
+    return mod_run_io(argv[0], args, rt, out_fd >= 0 ? &sink : nullptr, in_fd >= 0 ? &in : nullptr);
+  };
+  return mods;
 }
 
-/* ---------------- Builtin CALLs ---------------- */
+int Runtime::sh_exec(const std::string& line, const std::function<bool(const std::string&)>& mod_stage,
+                     const std::vector<Stage>* parsed){
+  // Native pipelines (posix_spawn); /bin/sh -c only when shell syntax is used.
+  InProcStages mods = mod_stages(*this, mod_stage);
+  // Stages run off this thread: keep the SIGINT trap out of their way
+  bool trap = trap_sigint;
+  trap_sigint = false;
+  int rc = run_command_line(line, &mods, parsed);
+  trap_sigint = trap;
+  return rc;
+}
 
-#ifndef _WIN32
-static std::vector<std::string> glob_items(const std::string& pat){
-  glob_t g{}; std::vector<std::string> out;
-  if(glob(pat.c_str(), 0, nullptr, &g) == 0){
-    for(size_t i=0; i<g.gl_pathc; ++i) out.emplace_back(g.gl_pathv[i]);
+// Collect a Shell.Start/Parallel batch; Ctrl-C cancels it. Statuses come
+// back as a list in input order; Shell.Status() is the first non-zero one.
+static std::string parallel_wait(Runtime& rt, ParallelBatch& batch){
+  // Outside RUN nothing traps SIGINT for us.
+  std::optional<RtSigintScope> sig;
+  struct sigaction cur{};
+  if(rt.trap_sigint && sigaction(SIGINT, nullptr, &cur) == 0 && cur.sa_handler != rt_on_sigint) sig.emplace();
+  const std::vector<int>& status = batch.wait([&rt]{ return rt_interrupted(rt); });
+  rt.parallel_out = batch.outputs();
+  rt.shell_status = 0;
+  std::string out = "[";
+  for(size_t i=0;i<status.size();++i){
+    if(i) out += ",";
+    out += std::to_string(status[i]);
+    if(!rt.shell_status) rt.shell_status = status[i];
   }
-  globfree(&g);
-  return out;
+  return out + "]";
+}
+
+// FS.Walk/FS.WalkOpen options:
+// "depth=N,name=*.cpp|*.hpp,type=f|d|l,hidden=1,follow=1,sort=1"
+static WalkOptions walk_options(const std::string& spec){
+  WalkOptions opt;
+  for(const std::string& kv : split_csv_like(spec)){
+    size_t eq = kv.find('=');
+    std::string key = trim(kv.substr(0, eq)), val = eq == std::string::npos ? "1" : trim(kv.substr(eq + 1));
+    for(char& c : key) c = (char)std::tolower((unsigned char)c);
+    if(key == "depth")       opt.max_depth = std::atoi(val.c_str());
+    else if(key == "type")   opt.type = val.empty() ? 0 : (char)std::tolower((unsigned char)val[0]);
+    else if(key == "hidden") opt.hidden = val != "0";
+    else if(key == "follow") opt.follow = val != "0";
+    else if(key == "sort")   opt.sort = val != "0";
+    else if(key == "name"){
+      size_t start = 0;
+      for(size_t bar; (bar = val.find('|', start)) != std::string::npos; start = bar + 1)
+        opt.names.push_back(val.substr(start, bar - start));
+      opt.names.push_back(val.substr(start));
+    }
+  }
+  return opt;
 }
-#endif
+
+/* ---------------- Builtin CALLs ---------------- */
 
 
 static void rng_autoseed(Runtime& rt){
@@ -597,9 +1053,21 @@ static void rng_autoseed(Runtime& rt){
   rt.rng_seeded = true;
 }
 
+// Builtins a restricted runtime may not call: they change the environment,
+// files, processes or the registry under the REPL, or read its terminal.
+static bool restricted_builtin(const std::string& up){
+  static const std::unordered_set<std::string> kDenied = {
+    "ENV.SET", "ENV.EXIT", "TTY.READLINE", "TTY.EOF",
+    "FS.WRITE", "FS.APPEND", "FS.OPENWRITE", "FS.OPENAPPEND", "FS.WRITEHANDLE",
+    "FS.FLUSH", "FS.DELETE", "MOD.REGISTER", "PROMPT.SETTEMPLATE",
+  };
+  return starts_with(up, "SHELL.") || kDenied.count(up) != 0;
+}
+
 Value call_dispatch(Runtime& rt, const std::string& qname, const std::vector<Value>& args){
   std::string up = qname;
   for(char& c : up) c = (char)std::toupper((unsigned char)c);
+  if(rt.restricted && restricted_builtin(up)) return Value{};
 
   auto wantN = [&](size_t n){ return args.size() == n; };
   auto asS   = [&](size_t i){ return std::holds_alternative<std::string>(args[i]) ? std::get<std::string>(args[i]) : to_string(args[i]); };
@@ -609,8 +1077,7 @@ Value call_dispatch(Runtime& rt, const std::string& qname, const std::vector<Val
   if(up=="ENV.CWD" && wantN(0)) return str(fs::current_path().string());
 
   if(up=="ENV.ARGS" && wantN(0)){
-    auto it = rt.vars.find("PB_ARGV");
-    if(it != rt.vars.end()) return it->second;
+    if(const Value* v = rt.lookup("PB_ARGV")) return *v;
     return str("[]");
   }
 
@@ -625,45 +1092,141 @@ Value call_dispatch(Runtime& rt, const std::string& qname, const std::vector<Val
 #else
     _putenv_s(asS(0).c_str(), asS(1).c_str());
 #endif
+    if(asS(0) == "PATH") command_hash_clear();   // cached command paths are stale
+    prompt_invalidate();
     return str(asS(1));
   }
 
   if(up=="ENV.EXIT" && wantN(1)){
+    writers_flush_all();
+    stdout_flush();
     std::exit((int)asD(0));
   }
 
   // ------- TTY.*
   if(up=="TTY.READLINE" && wantN(1)){
-    std::cout << asS(0) << std::flush;
-    std::string line; std::getline(std::cin, line);
+    if(!rt.input){
+      std::string prompt = asS(0);
+      rt.counters.bytes += prompt.size();
+      stdout_sink().write(prompt.data(), prompt.size());
+    }
+    std::string line; rt.read_line(line);
     return str(line);
   }
-  if(up=="TTY.WRITE" && wantN(1))     { std::cout << asS(0); return Value{}; }
-  if(up=="TTY.WRITELINE" && wantN(1)) { std::cout << asS(0) << "\n"; return Value{}; }
+  if(up=="TTY.EOF" && wantN(0)){
+    std::istream& in = rt.input ? *rt.input : std::cin;
+    return num(in.peek() == std::char_traits<char>::eof() ? 1.0 : 0.0);
+  }
+  if(up=="TTY.WRITE" && wantN(1))     { rt.write_out(asS(0)); return Value{}; }
+  if(up=="TTY.WRITELINE" && wantN(1)) { rt.write_out(asS(0) + "\n"); return Value{}; }
+  if(up=="TTY.FLUSH" && wantN(0))     { if(!rt.sink) stdout_flush(); return Value{}; }
 
   // ------- FS.* (use error_code to avoid throwing)
   std::error_code ec;
 
   if(up=="FS.READ" && wantN(1)){
-    std::ifstream f(asS(0));
-    if(!f) return str("");
-    std::stringstream ss; ss << f.rdbuf();
-    return str(ss.str());
+    std::string text;
+    if(!read_file(asS(0), text)) return str("");
+    return str(std::move(text));
+  }
+
+  if(up=="FS.READMANY" && wantN(1)){
+    // contents in input order, "" for files that cannot be read
+    return str(join_list(read_many(split_list(asS(0)))));
+  }
+  if(up=="FS.STATMANY" && (wantN(1) || wantN(2))){
+    // one field per path: size (default), mtime, type or exists; missing
+    // paths give -1 ("" for type, 0 for exists)
+    std::string field = wantN(2) ? asS(1) : "size";
+    for(char& c : field) c = (char)std::tolower((unsigned char)c);
+    std::vector<FileStat> st = stat_many(split_list(asS(0)));
+    std::vector<std::string> items;
+    items.reserve(st.size());
+    for(const FileStat& s : st){
+      if(field == "exists")     items.push_back(s.ok ? "1" : "0");
+      else if(field == "type")  items.push_back(!s.ok ? "" : s.kind=='f' ? "file" : s.kind=='d' ? "dir" : "other");
+      else if(!s.ok)            items.push_back("-1");
+      else if(field == "mtime") items.push_back(std::to_string(s.mtime));
+      else                      items.push_back(std::to_string(s.size));
+    }
+    return str(join_list(items));
+  }
+
+  if(up=="FS.OPEN" && wantN(1)){
+    auto f = std::make_shared<FileReader>(asS(0));
+    if(!f->ok()) return num(0);
+    int h = rt.next_file++;
+    rt.files[h] = std::move(f);
+    return num((Number)h);
+  }
+  if((up=="FS.READLINE" || up=="FS.EOF" || up=="FS.CLOSE") && wantN(1)){
+    if(auto wk = rt.walks.find((int)asD(0)); wk != rt.walks.end()){
+      if(up=="FS.EOF") return num(wk->second->eof() ? 1.0 : 0.0);
+      if(up=="FS.READLINE"){
+        std::string path;
+        wk->second->next(path);
+        return str(std::move(path));
+      }
+      rt.walks.erase(wk);
+      return Value{};
+    }
+    auto it = rt.files.find((int)asD(0));
+    if(it == rt.files.end()){
+      // FS.Close of a writer: 0, or 1 if a write or sync failed
+      auto w = rt.writers.find((int)asD(0));
+      if(up!="FS.CLOSE" || w == rt.writers.end()) return Value{};
+      bool ok = w->second->close();
+      rt.writers.erase(w);
+      return num(ok ? 0.0 : 1.0);
+    }
+    if(up=="FS.EOF") return num(it->second->eof() ? 1.0 : 0.0);
+    if(up=="FS.READLINE"){
+      std::string line;
+      it->second->read_line(line);
+      return str(std::move(line));
+    }
+    rt.files.erase(it);
+    return Value{};
   }
 
   if(up=="FS.WRITE" && wantN(2)){
+    glob_cache_invalidate();
     std::ofstream f(asS(0));
     if(f) f << asS(1);
     return Value{};
   }
 
   if(up=="FS.APPEND" && wantN(2)){
-    std::ofstream f(asS(0), std::ios::app);
-    if(f) f << asS(1);
+    glob_cache_invalidate();
+    (void)append_file(asS(0), asS(1));
     return Value{};
   }
 
+  if((up=="FS.OPENWRITE" || up=="FS.OPENAPPEND") && (wantN(1) || wantN(2))){
+    // optional sync policy: 0 none, 1 fsync on close, 2 after every write
+    int sync = wantN(2) ? std::clamp((int)asD(1), 0, 2) : 0;
+    glob_cache_invalidate();
+    auto w = std::make_shared<FileWriter>(asS(0), up=="FS.OPENAPPEND", (FileWriter::Sync)sync);
+    if(!w->ok()) return num(0);
+    int h = rt.next_file++;
+    rt.writers[h] = std::move(w);
+    return num((Number)h);
+  }
+  if(up=="FS.WRITEHANDLE" && wantN(2)){
+    auto it = rt.writers.find((int)asD(0));
+    if(it == rt.writers.end()) return num(1);
+    std::string text = asS(1);
+    return num(it->second->write(text.data(), text.size()) ? 0.0 : 1.0);
+  }
+  if(up=="FS.FLUSH" && wantN(1)){
+    auto it = rt.writers.find((int)asD(0));
+    if(it == rt.writers.end()) return num(1);
+    return num(it->second->flush() ? 0.0 : 1.0);
+  }
+
   if(up=="FS.DELETE" && wantN(1)){
+    append_cache_forget(asS(0));
+    glob_cache_invalidate();
     fs::remove(asS(0), ec);
     return Value{};
   }
@@ -680,22 +1243,28 @@ Value call_dispatch(Runtime& rt, const std::string& qname, const std::vector<Val
     return str(out);
   }
 
+  if(up=="FS.WALK" && (wantN(1) || wantN(2))){
+    return str(join_list(walk_tree(asS(0), walk_options(wantN(2) ? asS(1) : std::string()))));
+  }
+  if(up=="FS.WALKOPEN" && (wantN(1) || wantN(2))){
+    // read with FS.ReadLine/FS.Eof/FS.Close, one path per call
+    auto w = std::make_shared<WalkStream>(asS(0), walk_options(wantN(2) ? asS(1) : std::string()));
+    if(!w->ok()) return num(0);
+    int h = rt.next_file++;
+    rt.walks[h] = std::move(w);
+    return num((Number)h);
+  }
+
   if(up=="FS.EXISTS" && wantN(1)){
     bool ok = fs::exists(asS(0), ec);
     return num((ok && !ec) ? 1.0 : 0.0);
   }
 
-#ifndef _WIN32
   if(up=="FS.GLOB" && wantN(1)){
     std::string out;
-    for(const auto& p : glob_items(asS(0))) { out += p; out += "\n"; }
-    return str(out);
-  }
-#else
-  if(up=="FS.GLOB" && wantN(1)){
-    return str("");
+    for(const auto& p : glob_expand(asS(0))) { out += p; out += "\n"; }
+    return str(std::move(out));
   }
-#endif
 
   // ------- Mod.*
   if(up=="MOD.REGISTER" && wantN(2)) {
@@ -706,19 +1275,123 @@ Value call_dispatch(Runtime& rt, const std::string& qname, const std::vector<Val
   }
   if(up=="MOD.LIST" && wantN(0)) {
     std::string out;
+    std::lock_guard<std::mutex> lk(g_mods_mu);
     for (auto& kv : g_mods) { out += kv.first; out += "\n"; }
     return str(out);
   }
+  if(up=="MOD.STATS" && wantN(0)) return str(mod_stats_table(true));
+  if(up=="MOD.CAPTURE" && args.size() >= 1){
+    // Run a mod and return everything it printed (no temp files, no fork)
+    std::vector<std::string> margs;
+    for(size_t i=1;i<args.size();++i) margs.push_back(asS(i));
+    StringSink cap;
+    (void)mod_run_io(asS(0), margs, rt, &cap, nullptr);
+    return str(std::move(cap.buf));
+  }
+
+  // ------- Shell.* (the passthrough launcher, from BASIC)
+  constexpr size_t kCaptureMax = size_t(64) << 20;   // default per-command capture cap
+  if(up=="SHELL.RUN" && wantN(1)){
+    rt.shell_status = rt.sh_exec(asS(0));
+    return num((Number)rt.shell_status);
+  }
+  if(up=="SHELL.CAPTURE" && (wantN(1) || wantN(2))){
+    // stdout through a pipe into a growable buffer. Past `max` bytes (default
+    // 64 MiB) output is still read, so the command can finish, but dropped.
+    size_t cap = kCaptureMax;
+    if(wantN(2)) cap = (size_t)std::max(0.0, asD(1));
+    InProcStages mods = mod_stages(rt, {});
+    bool trap = rt.trap_sigint;
+    rt.trap_sigint = false;
+    std::string out;
+    {
+      CommandReader cmd(asS(0), &mods);
+      char buf[65536];
+      while(size_t n = cmd.read(buf, sizeof buf))
+        if(out.size() < cap) out.append(buf, std::min(n, cap - out.size()));
+      rt.shell_status = cmd.close();
+    }
+    rt.trap_sigint = trap;
+    return str(std::move(out));
+  }
+  if(up=="SHELL.LINES" && wantN(1)){
+    // The program keeps running while the command does, so no mod stages:
+    // they would share this runtime's variables from another thread.
+    auto cmd = std::make_shared<CommandReader>(asS(0));
+    if(!cmd->ok()){ rt.shell_status = cmd->close(); return num(0); }
+    int h = rt.next_reader++;
+    rt.readers[h] = std::move(cmd);
+    return num((Number)h);
+  }
+  if((up=="SHELL.READLINE" || up=="SHELL.EOF" || up=="SHELL.CLOSE") && wantN(1)){
+    auto it = rt.readers.find((int)asD(0));
+    if(it == rt.readers.end()) return Value{};
+    std::istream& in = it->second->in();
+    if(up=="SHELL.EOF") return num(in.peek() == std::char_traits<char>::eof() ? 1.0 : 0.0);
+    if(up=="SHELL.READLINE"){
+      std::string line;
+      std::getline(in, line);
+      return str(std::move(line));
+    }
+    rt.shell_status = it->second->close();
+    rt.readers.erase(it);
+    return num((Number)rt.shell_status);
+  }
+  if(up=="SHELL.STATUS" && wantN(0)) return num((Number)rt.shell_status);
+  if((up=="SHELL.PARALLEL" || up=="SHELL.START") && args.size() >= 1 && args.size() <= 4){
+    // No mod stages: commands run on several threads. Shell.Start returns a
+    // handle at once; Shell.Parallel waits and returns the statuses.
+    size_t jobs = args.size() >= 2 ? (size_t)std::max(0.0, asD(1)) : 0;
+    bool capture = args.size() >= 3 && truthy(args[2]);
+    size_t cap = args.size() >= 4 ? (size_t)std::max(0.0, asD(3)) : kCaptureMax;
+    auto batch = std::make_shared<ParallelBatch>(split_list(asS(0)), jobs, capture, cap);
+    if(up=="SHELL.PARALLEL") return str(parallel_wait(rt, *batch));
+    int h = rt.next_batch++;
+    rt.batches[h] = std::move(batch);
+    return num((Number)h);
+  }
+  if((up=="SHELL.PROGRESS" || up=="SHELL.WAIT") && wantN(1)){
+    auto it = rt.batches.find((int)asD(0));
+    if(it == rt.batches.end()) return Value{};
+    if(up=="SHELL.PROGRESS"){
+      // [total, started, done, failed], live while the batch runs
+      const ParallelProgress& p = it->second->progress();
+      return str("[" + std::to_string(p.total.load()) + "," + std::to_string(p.started.load()) + "," +
+                 std::to_string(p.done.load()) + "," + std::to_string(p.failed.load()) + "]");
+    }
+    std::string out = parallel_wait(rt, *it->second);
+    rt.batches.erase(it);
+    return str(std::move(out));
+  }
+  if(up=="SHELL.OUTPUT" && wantN(1)){
+    double i = asD(0);   // 1-based, like List.Get
+    if(i < 1 || i > (double)rt.parallel_out.size()) return str("");
+    return str(rt.parallel_out[(size_t)i - 1]);
+  }
+
+  // ------- List.* (list values: JSON-ish arrays like PB_ARGV, or one item per line)
+  if(up=="LIST.COUNT" && wantN(1)) return num((Number)split_list(asS(0)).size());
+  if(up=="LIST.GET" && wantN(2)){
+    std::vector<std::string> items = split_list(asS(0));
+    double i = asD(1);
+    if(i < 1 || i > (double)items.size()) return str("");
+    return str(std::move(items[(size_t)i - 1]));
+  }
 
   // ------- Prompt.* (template control from BASIC/mods)
   if(up=="PROMPT.SETTEMPLATE" && wantN(1)){
     rt.vars["PB_PROMPT_TMPL"] = asS(0);
+    prompt_invalidate();
+    return Value{};
+  }
+  if(up=="PROMPT.INVALIDATE" && wantN(0)){
+    prompt_invalidate();  // force the next prompt to be rebuilt
     return Value{};
   }
   if(up=="PROMPT.GET" && wantN(0)){
     // Interpreter assembles final prompt; here just return stored template (if any)
-    auto itp = rt.vars.find("PB_PROMPT_TMPL");
-    return itp==rt.vars.end()? str("") : itp->second;
+    const Value* v = rt.lookup("PB_PROMPT_TMPL");
+    return v ? *v : str("");
   }
 
   // --- RNG.* ---------------------------------------------------------------
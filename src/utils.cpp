@@ -1,8 +1,13 @@
 #include "prismshell/utils.hpp"
 #include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <sstream>
 #include <iomanip>
 #include <regex>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 
 namespace pb {
@@ -34,6 +39,116 @@ if(!cur.empty()) out.push_back(trim(cur)); return out;
 }
 
 
+std::vector<std::string> tokenize_quoted(const std::string& line){
+std::vector<std::string> out; std::string cur;
+bool in_single=false, in_double=false, escaping=false;
+auto push = [&](){ out.push_back(cur); cur.clear(); };
+for(size_t i=0;i<line.size();++i){
+char c=line[i];
+if(escaping){ cur.push_back(c); escaping=false; continue; }
+if(c=='\\'){ if(in_single) cur.push_back(c); else escaping=true; continue; }
+if(c=='\'' && !in_double){ in_single=!in_single; continue; }
+if(c=='"' && !in_single){ in_double=!in_double; continue; }
+if(std::isspace((unsigned char)c) && !in_single && !in_double){
+if(!cur.empty()) push();
+while(i+1<line.size() && std::isspace((unsigned char)line[i+1])) ++i;
+continue;
+}
+cur.push_back(c);
+}
+if(!cur.empty() || (!in_single && !in_double && out.empty())) push();
+return out;
+}
+
+
+static void json_escape(std::string& out, const std::string& in){
+for(unsigned char c: in){
+switch(c){
+case '\\': out += "\\\\"; break;
+case '"' : out += "\\\""; break;
+case '\b': out += "\\b"; break;
+case '\f': out += "\\f"; break;
+case '\n': out += "\\n"; break;
+case '\r': out += "\\r"; break;
+case '\t': out += "\\t"; break;
+default:
+if(c < 0x20){ char b[8]; std::snprintf(b,sizeof(b),"\\u%04x", c); out += b; }
+else out += (char)c;
+}
+}
+}
+
+
+std::string join_list(const std::vector<std::string>& items){
+std::string out="[";
+for(size_t i=0;i<items.size();++i){ if(i) out+=","; out+='"'; json_escape(out, items[i]); out+='"'; }
+out+="]"; return out;
+}
+
+
+static void put_utf8(std::string& out, unsigned cp){
+if(cp<0x80) out.push_back((char)cp);
+else if(cp<0x800){ out.push_back((char)(0xC0|(cp>>6))); out.push_back((char)(0x80|(cp&0x3F))); }
+else { out.push_back((char)(0xE0|(cp>>12))); out.push_back((char)(0x80|((cp>>6)&0x3F))); out.push_back((char)(0x80|(cp&0x3F))); }
+}
+
+
+std::vector<std::string> split_list(const std::string& s){
+std::vector<std::string> out;
+std::string t=trim(s);
+if(t.size()>=2 && t.front()=='[' && t.back()==']'){
+// elements: "strings" with JSON escapes ('single' too: BASIC strings cannot
+// contain a double quote), or bare tokens up to the next comma
+size_t i=1, end=t.size()-1;
+while(i<end){
+while(i<end && (std::isspace((unsigned char)t[i]) || t[i]==',')) ++i;
+if(i>=end) break;
+std::string cur;
+if(t[i]=='"' || t[i]=='\''){
+const char q=t[i];
+for(++i; i<end && t[i]!=q; ++i){
+if(t[i]!='\\' || i+1>=end){ cur.push_back(t[i]); continue; }
+char e=t[++i];
+switch(e){
+case 'n': cur.push_back('\n'); break;
+case 't': cur.push_back('\t'); break;
+case 'r': cur.push_back('\r'); break;
+case 'b': cur.push_back('\b'); break;
+case 'f': cur.push_back('\f'); break;
+case 'u': if(i+4<end){ put_utf8(cur, (unsigned)std::strtoul(t.substr(i+1,4).c_str(), nullptr, 16)); i+=4; } break;
+default: cur.push_back(e);
+}
+}
+++i; // closing quote
+} else {
+size_t c=t.find(',', i); if(c==std::string::npos || c>end) c=end;
+cur=trim(t.substr(i, c-i)); i=c;
+}
+out.push_back(std::move(cur));
+}
+return out;
+}
+std::istringstream in(s); std::string line;
+while(std::getline(in, line)){ if(!line.empty() && line.back()=='\r') line.pop_back(); if(!trim(line).empty()) out.push_back(line); }
+return out;
+}
+
+
+void parallel_for(size_t n, const std::function<void(size_t)>& fn, unsigned max_threads){
+if(n==0) return;
+unsigned hw = std::thread::hardware_concurrency(); if(hw==0) hw=2;
+unsigned want = max_threads ? max_threads : hw;
+size_t workers = std::min<size_t>(want, n);
+if(workers<=1){ for(size_t i=0;i<n;++i) fn(i); return; }
+std::atomic<size_t> next{0};
+auto loop=[&]{ for(size_t i; (i=next.fetch_add(1, std::memory_order_relaxed))<n; ) fn(i); };
+std::vector<std::thread> pool; pool.reserve(workers-1);
+for(size_t w=1; w<workers; ++w) pool.emplace_back(loop);
+loop(); // calling thread works too
+for(auto& t: pool) t.join();
+}
+
+
 std::string to_string(const Value& v){
 if(std::holds_alternative<std::monostate>(v)) return "";
 if(std::holds_alternative<Number>(v)){